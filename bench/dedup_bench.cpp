@@ -0,0 +1,232 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: dedup_bench.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "argument_parser.h"
+#include "json_writer.h"
+#include "log_deduplicator.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double elapsed_ms(const clock_type::time_point start_time) {
+  return std::chrono::duration<double, std::milli>(clock_type::now() -
+                                                   start_time)
+      .count();
+}
+
+double megabytes_per_second(const std::size_t bytes,
+                            const double milliseconds) {
+  return milliseconds > 0.0 ? bytes / 1e3 / milliseconds : 0.0;
+}
+
+double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  const auto middle = values.begin() + values.size() / 2U;
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+
+/**
+ * \brief Write a log of roughly the given size in MiB
+ * \details Service logs repeat a few message templates with changing
+ * timestamps, IDs and durations, and now and then a stack trace.
+ */
+void write_synthetic_log(const std::filesystem::path &path,
+                         const std::size_t size_mib) {
+  constexpr const char *MESSAGES[] = {
+      "INFO  worker-%u picked job %u from queue default",
+      "INFO  request id=%08x GET /api/users/%u served in %ums",
+      "WARN  cache miss for key session:%u:%u, loading from store",
+      "DEBUG gc pause %uus, heap %u MiB",
+      "ERROR timeout talking to db-%u after %ums, retrying"};
+  constexpr std::size_t NUMBER_OF_MESSAGES = std::size(MESSAGES);
+
+  std::ofstream file{path, std::ios::binary};
+  if (!file) {
+    throw std::runtime_error{"Cannot write synthetic log: " + path.string()};
+  }
+
+  const std::size_t size = size_mib * 1024U * 1024U;
+  std::string block;
+  std::uint32_t state{12345U};
+  std::size_t message{0U};
+  char line[256];
+  for (std::size_t written = 0U; written < size; written += block.size()) {
+    block.clear();
+    while (block.size() < 1024U * 1024U) {
+      state = state * 1664525U + 1013904223U;
+      const auto second = (state >> 4U) % 86400U;
+      auto length = std::snprintf(
+          line, sizeof(line), "2025-06-01T%02u:%02u:%02u.%03u ",
+          second / 3600U, second / 60U % 60U, second % 60U, state % 1000U);
+      block.append(line, static_cast<std::size_t>(length));
+
+      // Runs of the same message are common, so the template changes
+      // only every few lines
+      if ((state >> 24U) % 8U == 0U) {
+        message = (state >> 12U) % NUMBER_OF_MESSAGES;
+      }
+      length = std::snprintf(line, sizeof(line), MESSAGES[message],
+                             state % 977U, (state >> 10U) % 5000U,
+                             (state >> 3U) % 300U);
+      block.append(line, static_cast<std::size_t>(length)).push_back('\n');
+
+      if (message == 4U) {
+        block.append("    at Pool.acquire (pool.cpp:118)\n"
+                     "    at Store.load (store.cpp:42)\n"
+                     "    at Worker.run (worker.cpp:77)\n");
+      }
+    }
+    file.write(block.data(), static_cast<std::streamsize>(block.size()));
+  }
+}
+
+/**
+ * \brief Count the lines the way a plain reader would, the speed to beat
+ */
+std::size_t count_lines(const std::string_view text) {
+  std::size_t number_of_lines{0U};
+  const char *position = text.data();
+  const char *const end = position + text.size();
+  while ((position = static_cast<const char *>(
+              std::memchr(position, '\n', end - position))) != nullptr) {
+    ++position;
+    ++number_of_lines;
+  }
+  return number_of_lines;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    ArgumentParser parser{
+        "Deduplication Benchmark\nMeasures how fast repeated log lines are "
+        "collapsed compared to only reading the lines, one JSON line per "
+        "input."};
+    parser
+        .add_option<std::string>("input", "i",
+                                 "Log file to measure, a synthetic log is "
+                                 "written if empty",
+                                 false, std::string{})
+        .add_option<int>("size", "s", "Size of the synthetic log in MiB",
+                         false, 2048)
+        .add_option<int>("threads", "j",
+                         "Threads hashing lines (0 = all hardware threads)",
+                         false, 0)
+        .add_option<int>("distance", "d",
+                         "Max differing simhash bits of near duplicates",
+                         false, 3)
+        .add_option<int>("repetitions", "r", "Measured runs", false, 3)
+        .add_option<std::string>("output", "o",
+                                 "File to write the JSON lines to", false,
+                                 std::string{})
+        .parse(argc, argv);
+
+    const auto repetitions = static_cast<std::size_t>(
+        std::max(1, parser.get_option<int>("repetitions")));
+    model_wrapper::DedupSettings settings{};
+    settings.number_of_threads = static_cast<std::size_t>(
+        std::max(0, parser.get_option<int>("threads")));
+    settings.max_distance = static_cast<std::size_t>(
+        std::max(0, parser.get_option<int>("distance")));
+
+    const auto output_path = parser.get_option<std::string>("output");
+    std::ofstream output_file;
+    if (!output_path.empty()) {
+      output_file.open(output_path);
+      if (!output_file) {
+        throw std::runtime_error{"Cannot open output file: " + output_path};
+      }
+    }
+    std::ostream &out = output_path.empty() ? std::cout : output_file;
+
+    std::filesystem::path input_path{parser.get_option<std::string>("input")};
+    const bool is_synthetic = input_path.empty();
+    if (is_synthetic) {
+      input_path = std::filesystem::temp_directory_path() /
+                   ("dedup_bench-" + std::to_string(getpid()) + ".log");
+      write_synthetic_log(input_path, static_cast<std::size_t>(std::max(
+                                          1, parser.get_option<int>("size"))));
+    }
+
+    {
+      const model_wrapper::MappedFile file{input_path};
+      const auto text = file.get_view();
+
+      // The first pass pages the file in, the measured ones then compare
+      // the work per byte
+      std::size_t number_of_lines = count_lines(text);
+      std::vector<double> read_ms;
+      std::vector<double> dedup_ms;
+      model_wrapper::DedupResult result{};
+      const model_wrapper::LogDeduplicator deduplicator{settings};
+      for (std::size_t i = 0U; i < repetitions; ++i) {
+        auto start_time = clock_type::now();
+        number_of_lines = count_lines(text);
+        read_ms.push_back(elapsed_ms(start_time));
+
+        start_time = clock_type::now();
+        result = deduplicator.deduplicate(text);
+        dedup_ms.push_back(elapsed_ms(start_time));
+      }
+
+      const auto read_median_ms = median(read_ms);
+      const auto dedup_median_ms = median(dedup_ms);
+      model_wrapper::JsonWriter record;
+      record
+          .add("input", is_synthetic ? std::string{"synthetic"}
+                                     : input_path.string())
+          .add("input_bytes", static_cast<std::uint64_t>(text.size()))
+          .add("input_lines", static_cast<std::uint64_t>(number_of_lines))
+          .add("threads", static_cast<std::uint64_t>(
+                              settings.number_of_threads))
+          .add("max_distance",
+               static_cast<std::uint64_t>(settings.max_distance))
+          .add("repetitions", static_cast<std::uint64_t>(repetitions))
+          .add("read_ms", read_median_ms)
+          .add("read_mb_per_s",
+               megabytes_per_second(text.size(), read_median_ms))
+          .add("dedup_ms", dedup_median_ms)
+          .add("dedup_mb_per_s",
+               megabytes_per_second(text.size(), dedup_median_ms))
+          .add("output_bytes", static_cast<std::uint64_t>(result.text.size()))
+          .add("output_lines", static_cast<std::uint64_t>(result.output_lines))
+          .add("kept_ratio",
+               text.empty() ? 0.0
+                            : static_cast<double>(result.text.size()) /
+                                  text.size());
+      out << record.str() << std::endl;
+    }
+
+    if (is_synthetic) {
+      std::filesystem::remove(input_path);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Failed: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,374 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: summarize_bench.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "argument_parser.h"
+#include "chunked_summarizer.h"
+#include "json_writer.h"
+#include "model.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * \brief A named benchmark input
+ */
+struct BenchInput {
+  std::string name;
+  std::string text;
+};
+
+double elapsed_ms(const clock_type::time_point start_time) {
+  return std::chrono::duration<double, std::milli>(clock_type::now() -
+                                                   start_time)
+      .count();
+}
+
+double per_second(const double count, const double milliseconds) {
+  return milliseconds > 0.0 ? count * 1000.0 / milliseconds : 0.0;
+}
+
+std::uint64_t peak_rss_kb() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<std::uint64_t>(usage.ru_maxrss);
+}
+
+double percentile(std::vector<double> values, const double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  const auto index = static_cast<std::size_t>(fraction * (values.size() - 1U));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+double median(std::vector<double> values) { return percentile(values, 0.5); }
+
+std::vector<std::size_t> parse_sizes(const std::string &sizes) {
+  std::vector<std::size_t> parsed;
+  std::stringstream stream{sizes};
+  std::string size;
+  while (std::getline(stream, size, ',')) {
+    if (!size.empty()) {
+      parsed.push_back(std::stoul(size));
+    }
+  }
+  return parsed;
+}
+
+/**
+ * \brief Build a deterministic text of roughly the given number of tokens
+ */
+std::string make_synthetic_text(const model_wrapper::Model &model,
+                                const std::size_t number_of_tokens) {
+  constexpr const char *WORDS[] = {
+      "the",     "server",  "accepts", "a",        "connection", "and",
+      "reads",   "request", "headers", "before",   "it",         "checks",
+      "cache",   "entry",   "for",     "resource", "which",      "expires",
+      "after",   "timeout", "while",   "worker",   "threads",    "process",
+      "queued",  "jobs",    "from",    "shared",   "buffer",     "then",
+      "flushes", "output",  "to",      "disk"};
+  constexpr std::size_t NUMBER_OF_WORDS = std::size(WORDS);
+
+  std::string text;
+  std::uint32_t state{12345U};
+  std::size_t sentence_length{0U};
+
+  // Words are about one token each, top up until the count is reached
+  while (true) {
+    for (std::size_t i = 0U; i < number_of_tokens; ++i) {
+      state = state * 1664525U + 1013904223U;
+      text.append(WORDS[(state >> 8U) % NUMBER_OF_WORDS]);
+      if (++sentence_length > 12U + (state >> 28U)) {
+        text.append(".\n");
+        sentence_length = 0U;
+      } else {
+        text.push_back(' ');
+      }
+    }
+
+    const auto tokens = model.tokenize_text(text);
+    if (tokens.size() >= number_of_tokens) {
+      return model.detokenize(
+          std::span<const llama_token>{tokens}.first(number_of_tokens));
+    }
+  }
+}
+
+std::vector<BenchInput> load_corpus(const std::filesystem::path &directory) {
+  std::vector<BenchInput> inputs;
+  if (!std::filesystem::is_directory(directory)) {
+    return inputs;
+  }
+
+  for (const auto &entry : std::filesystem::directory_iterator{directory}) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    std::ifstream file{entry.path(), std::ios::binary};
+    inputs.push_back({entry.path().filename().string(),
+                      std::string{std::istreambuf_iterator<char>(file),
+                                  std::istreambuf_iterator<char>()}});
+  }
+
+  std::sort(inputs.begin(), inputs.end(),
+            [](const auto &lhs, const auto &rhs) {
+              return lhs.name < rhs.name;
+            });
+  return inputs;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    ArgumentParser parser{
+        "Summarizer Benchmark\nMeasures tokenization, prefill, decode, time "
+        "to first token, per-token latency and peak RSS on synthetic inputs "
+        "and a corpus, one JSON line per input."};
+    parser
+        .add_option<std::string>("model", "m", "The path to the model file",
+                                 false, std::string{DEFAULT_MODEL_PATH})
+        .add_option<std::string>("corpus", "c",
+                                 "Directory with text files to measure", false,
+                                 std::string{DEFAULT_CORPUS_PATH})
+        .add_option<std::string>("sizes", "s",
+                                 "Comma separated synthetic input sizes in "
+                                 "tokens",
+                                 false, std::string{"256,1024,4096"})
+        .add_option<int>("repetitions", "r", "Measured runs per input", false,
+                         3)
+        .add_option<int>("predict", "p", "Maximum tokens to generate", false,
+                         128)
+        .add_option<float>("temperature", "t", "The temperature", false, 0.5f)
+        .add_option<std::string>("output", "o",
+                                 "File to write the JSON lines to", false,
+                                 std::string{})
+        .add_option<std::string>("draft-model", "",
+                                 "Draft model for speculative decoding",
+                                 false, std::string{})
+        .add_flag("prompt-lookup", "",
+                  "Speculate with tokens copied from the input", false)
+        .add_option<int>("tokenize-size", "",
+                         "Size in MiB of the text that compares parallel "
+                         "with serial tokenization (0 = skip)",
+                         false, 64)
+        .parse(argc, argv);
+
+    const auto model_path = parser.get_option<std::string>("model");
+    const auto temperature = parser.get_option<float>("temperature");
+    const auto repetitions = static_cast<std::size_t>(
+        std::max(1, parser.get_option<int>("repetitions")));
+    const auto prediction_length = static_cast<std::size_t>(
+        std::max(1, parser.get_option<int>("predict")));
+    const std::int32_t number_of_gpu_layers{99};
+
+    const auto output_path = parser.get_option<std::string>("output");
+    std::ofstream output_file;
+    if (!output_path.empty()) {
+      output_file.open(output_path);
+      if (!output_file) {
+        throw std::runtime_error{"Cannot open output file: " + output_path};
+      }
+    }
+    std::ostream &out = output_path.empty() ? std::cout : output_file;
+
+    const auto load_start = clock_type::now();
+    model_wrapper::Model model{model_path, temperature, number_of_gpu_layers,
+                               prediction_length};
+    const auto load_ms = elapsed_ms(load_start);
+
+    const auto draft_model_path = parser.get_option<std::string>("draft-model");
+    const auto is_prompt_lookup = parser.get_option<bool>("prompt-lookup");
+    if (!draft_model_path.empty()) {
+      model.enable_draft_model(draft_model_path, number_of_gpu_layers, {});
+    } else if (is_prompt_lookup) {
+      model.enable_prompt_lookup({});
+    }
+
+    model_wrapper::ChunkedSummarizer summarizer{
+        model,
+        {"You are a document summarizer. Summarize the text in 3-5 "
+         "sentences.\n\nTEXT:\n",
+         "\n\nSHORT SUMMARY:\n"},
+        {}};
+
+    std::vector<BenchInput> inputs;
+    const auto sizes = parse_sizes(parser.get_option<std::string>("sizes"));
+    for (const auto size : sizes) {
+      inputs.push_back({"synthetic-" + std::to_string(size),
+                        make_synthetic_text(model, size)});
+    }
+    for (auto &input : load_corpus(parser.get_option<std::string>("corpus"))) {
+      inputs.push_back(std::move(input));
+    }
+
+    // Parallel tokenization must give the same tokens as a single thread,
+    // a mismatch fails the benchmark
+    bool is_tokenization_matching{true};
+    if (const auto tokenize_size = static_cast<std::size_t>(std::max(
+            0, parser.get_option<int>("tokenize-size"))) *
+                                   1024U * 1024U;
+        tokenize_size > 0U && !inputs.empty()) {
+      std::string text;
+      while (text.size() < tokenize_size) {
+        for (const auto &input : inputs) {
+          text.append(input.text).push_back('\n');
+        }
+      }
+
+      std::vector<double> serial_ms;
+      std::vector<double> parallel_ms;
+      std::vector<llama_token> serial_tokens;
+      std::vector<llama_token> parallel_tokens;
+      for (std::size_t i = 0U; i < repetitions; ++i) {
+        auto start_time = clock_type::now();
+        serial_tokens = model.tokenize_text(text, 1U);
+        serial_ms.push_back(elapsed_ms(start_time));
+
+        start_time = clock_type::now();
+        parallel_tokens = model.tokenize_text(text);
+        parallel_ms.push_back(elapsed_ms(start_time));
+      }
+      is_tokenization_matching = serial_tokens == parallel_tokens;
+
+      const auto serial_median_ms = median(serial_ms);
+      const auto parallel_median_ms = median(parallel_ms);
+      model_wrapper::JsonWriter record;
+      record.add("input", "tokenize-" + std::to_string(text.size()))
+          .add("model", model_path)
+          .add("input_bytes", static_cast<std::uint64_t>(text.size()))
+          .add("document_tokens",
+               static_cast<std::uint64_t>(serial_tokens.size()))
+          .add("tokenize_serial_ms", serial_median_ms)
+          .add("tokenize_parallel_ms", parallel_median_ms)
+          .add("tokenize_serial_mb_per_s",
+               per_second(text.size() / 1e6, serial_median_ms))
+          .add("tokenize_parallel_mb_per_s",
+               per_second(text.size() / 1e6, parallel_median_ms))
+          .add("tokenize_parallel_matches", is_tokenization_matching);
+      out << record.str() << std::endl;
+      if (!is_tokenization_matching) {
+        std::cerr << "Parallel tokenization differs from serial!"
+                  << std::endl;
+      }
+    }
+
+    for (const auto &input : inputs) {
+      // Tokenization is measured on the whole input
+      std::vector<double> tokenize_ms;
+      std::size_t document_tokens{0U};
+      for (std::size_t i = 0U; i < repetitions; ++i) {
+        const auto start_time = clock_type::now();
+        document_tokens = model.tokenize_text(input.text).size();
+        tokenize_ms.push_back(elapsed_ms(start_time));
+      }
+
+      // Generation needs a single prompt, longer inputs are cut to a chunk
+      std::string document = input.text;
+      const bool is_truncated = document_tokens > summarizer.get_chunk_tokens();
+      if (is_truncated) {
+        const auto tokens = model.tokenize_text(document);
+        document = model.detokenize(std::span<const llama_token>{tokens}.first(
+            summarizer.get_chunk_tokens()));
+      }
+      const auto prompt = summarizer.format_prompt(document);
+
+      // One unmeasured run warms up caches and creates the pooled context
+      std::ostringstream discarded;
+      model.generate_response(prompt, discarded);
+
+      std::vector<double> prefill_rates;
+      std::vector<double> decode_rates;
+      std::vector<double> time_to_first_token;
+      std::vector<double> token_latencies;
+      model_wrapper::GenerationStats last_stats{};
+      model_wrapper::GenerationStats total_stats{};
+      for (std::size_t i = 0U; i < repetitions; ++i) {
+        std::ostringstream summary;
+        last_stats = model.generate_response(prompt, summary);
+        total_stats += last_stats;
+
+        prefill_rates.push_back(per_second(
+            last_stats.prompt_tokens - last_stats.cached_tokens,
+            last_stats.prefill_ms));
+        decode_rates.push_back(per_second(last_stats.generated_tokens,
+                                          last_stats.decode_ms));
+        time_to_first_token.push_back(last_stats.time_to_first_token_ms);
+        token_latencies.insert(token_latencies.end(),
+                               last_stats.token_latencies_ms.begin(),
+                               last_stats.token_latencies_ms.end());
+      }
+
+      const auto tokenize_median_ms = median(tokenize_ms);
+      model_wrapper::JsonWriter record;
+      record.add("input", input.name)
+          .add("model", model_path)
+          .add("temperature", static_cast<double>(temperature))
+          .add("repetitions", static_cast<std::uint64_t>(repetitions))
+          .add("input_bytes", static_cast<std::uint64_t>(input.text.size()))
+          .add("document_tokens", static_cast<std::uint64_t>(document_tokens))
+          .add("truncated", is_truncated)
+          .add("model_load_ms", load_ms)
+          .add("piece_table_ms", model.get_piece_table().get_build_ms())
+          .add("piece_table_bytes",
+               static_cast<std::uint64_t>(
+                   model.get_piece_table().get_memory_bytes()))
+          .add("tokenize_ms", tokenize_median_ms)
+          .add("tokenize_tokens_per_s",
+               per_second(document_tokens, tokenize_median_ms))
+          .add("tokenize_mb_per_s",
+               per_second(input.text.size() / 1e6, tokenize_median_ms))
+          .add("prompt_tokens",
+               static_cast<std::uint64_t>(last_stats.prompt_tokens))
+          .add("generated_tokens",
+               static_cast<std::uint64_t>(last_stats.generated_tokens))
+          .add("prefill_tokens_per_s", median(prefill_rates))
+          .add("decode_tokens_per_s", median(decode_rates))
+          .add("ttft_ms", median(time_to_first_token))
+          .add("token_latency_p50_ms", percentile(token_latencies, 0.50))
+          .add("token_latency_p90_ms", percentile(token_latencies, 0.90))
+          .add("token_latency_p99_ms", percentile(token_latencies, 0.99))
+          .add("draft_model", draft_model_path)
+          .add("prompt_lookup", is_prompt_lookup)
+          .add("draft_acceptance_rate",
+               total_stats.draft_tokens > 0U
+                   ? static_cast<double>(total_stats.accepted_draft_tokens) /
+                         total_stats.draft_tokens
+                   : 0.0)
+          .add("tokens_per_target_decode",
+               total_stats.target_decodes > 0U
+                   ? static_cast<double>(total_stats.generated_tokens) /
+                         total_stats.target_decodes
+                   : 0.0)
+          .add("peak_rss_kb", peak_rss_kb());
+      out << record.str() << std::endl;
+    }
+
+    if (!is_tokenization_matching) {
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Failed: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
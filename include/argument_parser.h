@@ -9,6 +9,8 @@
 //   github: github.com/onurozuduru
 ///////////////////////////////////////////////////////////////////////////////
 
+#pragma once
+
 #include <any>
 #include <functional>
 #include <stdexcept>
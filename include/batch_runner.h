@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: batch_runner.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "chunked_summarizer.h"
+#include "model.h"
+#include "summary_cache.h"
+#include <cstddef>
+#include <filesystem>
+#include <ostream>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Summarizes many files with one loaded model
+ * \details Each input produces one JSON line with the path, the summary, the
+ * token counts and the timings. A failing input is reported in its own line
+ * and does not stop the rest of the batch. With several sequences, documents
+ * that fit into a single prompt are decoded together in one context and
+ * their lines are written in the order they finish. Larger documents are
+ * summarized chunk by chunk after the batch, from the tokens computed when
+ * they were admitted. With a summary cache,
+ * cached documents are answered without generating.
+ */
+class BatchRunner {
+private:
+  std::vector<std::filesystem::path> m_inputs;
+  const SummaryCache *m_summary_cache{nullptr};
+
+public:
+  /**
+   * \brief Add an input file or every regular file below a directory
+   * \param path The file or directory
+   * \throw std::runtime_error if the path does not exist
+   */
+  void add_path(const std::filesystem::path &path);
+
+  /**
+   * \brief Add the inputs listed in a manifest file
+   * \details The manifest has one path per line, empty lines and lines
+   * starting with '#' are skipped. Relative paths are resolved against the
+   * directory of the manifest.
+   * \param manifest_path The manifest file
+   * \throw std::runtime_error if the manifest cannot be read
+   */
+  void add_manifest(const std::filesystem::path &manifest_path);
+
+  /**
+   * \brief Get the collected inputs
+   * \return The input files
+   */
+  const std::vector<std::filesystem::path> &get_inputs() const;
+
+  /**
+   * \brief Look up and store the summaries in a cache
+   * \param summary_cache The cache, must outlive the runs, nullptr disables
+   * it
+   */
+  void set_summary_cache(const SummaryCache *summary_cache);
+
+  /**
+   * \brief Summarize every input and write the results as JSON lines
+   * \param model The loaded model
+   * \param summarizer The summarizer using the model
+   * \param out The output stream for the JSON lines
+   * \param number_of_sequences The number of documents decoded together
+   * \param total_stats If set, the stats of every summarized input are added
+   * to it
+   * \return The number of inputs that failed
+   * \throw std::runtime_error if batched decoding fails
+   */
+  std::size_t run(Model &model, ChunkedSummarizer &summarizer,
+                  std::ostream &out, const std::size_t number_of_sequences,
+                  SummaryStats *total_stats = nullptr) const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,24 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: cache_directory.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <filesystem>
+
+namespace model_wrapper {
+/**
+ * \brief Get the directory for the files kept between runs
+ * \details The directory is not created here.
+ * \return $XDG_CACHE_HOME or ~/.cache, followed by the application name, the
+ * temporary directory if neither is set
+ */
+std::filesystem::path get_default_cache_directory();
+} // namespace model_wrapper
@@ -0,0 +1,317 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: chunked_summarizer.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "extractive_selector.h"
+#include "log_deduplicator.h"
+#include "model.h"
+#include "prompt_builder.h"
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Prompts that wrap the document for summarization
+ */
+struct SummaryPrompt {
+  /**
+   * \brief The system prompt
+   */
+  std::string system_prompt;
+
+  /**
+   * \brief Text appended to the document in the user prompt
+   */
+  std::string user_prompt_end;
+};
+
+/**
+ * \brief Settings for splitting the document into chunks
+ */
+struct ChunkingSettings {
+  /**
+   * \brief Maximum number of document tokens per chunk, 0 derives it from the
+   * trained context size of the model
+   */
+  std::size_t chunk_tokens{0U};
+
+  /**
+   * \brief Number of tokens shared by two neighbouring chunks
+   */
+  std::size_t overlap_tokens{128U};
+
+  /**
+   * \brief Number of chunks to summarize at the same time
+   */
+  std::size_t parallel_jobs{1U};
+
+  /**
+   * \brief Maximum number of document tokens given to the model, larger
+   * documents are cut down to their most informative sentences first, 0
+   * keeps the whole document
+   */
+  std::size_t token_budget{0U};
+};
+
+/**
+ * \brief Settings for following an input that does not end
+ */
+struct FollowSettings {
+  /**
+   * \brief Number of new lines after which a summary is written
+   */
+  std::size_t summary_lines{100U};
+
+  /**
+   * \brief Time after the first new line after which a summary is written,
+   * even if fewer lines arrived
+   */
+  std::chrono::seconds summary_interval{60};
+};
+
+/**
+ * \brief Token counts and timings of a summarized document
+ */
+struct SummaryStats {
+  /**
+   * \brief Size of the document in bytes
+   */
+  std::size_t document_bytes{0U};
+
+  /**
+   * \brief Number of tokens in the document
+   */
+  std::size_t document_tokens{0U};
+
+  /**
+   * \brief Number of chunks summarized in the map steps
+   */
+  std::size_t number_of_chunks{0U};
+
+  /**
+   * \brief Number of document bytes left out to fit the token budget
+   */
+  std::size_t dropped_bytes{0U};
+
+  /**
+   * \brief Number of document tokens left out to fit the token budget
+   */
+  std::size_t dropped_tokens{0U};
+
+  /**
+   * \brief Number of document lines collapsed as repeats before
+   * tokenization
+   */
+  std::size_t collapsed_lines{0U};
+
+  /**
+   * \brief Accumulated stats of every generated response
+   */
+  GenerationStats generation{};
+};
+
+/**
+ * \brief Map-reduce summarizer for documents larger than the model context
+ * \details The document is split into overlapping token windows that fit the
+ * model context. Each window is summarized on its own (map), then the chunk
+ * summaries are joined and summarized again (reduce) until the result fits
+ * into a single prompt. Documents that already fit are summarized directly.
+ * With a token budget, documents over it are first reduced to their most
+ * informative sentences, see ExtractiveSelector.
+ */
+class ChunkedSummarizer {
+private:
+  Model &m_model;
+  const PromptBuilder m_prompt_builder;
+  const ChunkingSettings m_settings;
+  const ExtractiveSelector m_selector;
+  std::optional<LogDeduplicator> m_deduplicator;
+  std::size_t m_chunk_tokens{0U};
+  std::size_t m_reserved_tokens{0U};
+
+  /**
+   * \brief Split the tokens into overlapping windows
+   * \param tokens The document tokens
+   * \return The tokens of each window, viewing into the document tokens
+   */
+  std::vector<std::span<const llama_token>>
+  split_into_chunks(const std::vector<llama_token> &tokens) const;
+
+  /**
+   * \brief Summarize every chunk, in parallel if configured
+   * \param chunks The chunk tokens
+   * \param stats The stats to add the chunk responses to
+   * \return The summary of each chunk in the same order
+   * \throw std::runtime_error if any of the chunks fails
+   */
+  std::vector<std::string>
+  summarize_chunks(const std::vector<std::span<const llama_token>> &chunks,
+                   SummaryStats &stats) const;
+
+public:
+  /**
+   * \brief Construct a new ChunkedSummarizer object
+   * \param model The model to summarize with
+   * \param prompt The prompts to wrap each chunk with
+   * \param settings The chunking settings
+   * \throw std::runtime_error if the context is too small for the prompts
+   */
+  ChunkedSummarizer(Model &model, SummaryPrompt prompt,
+                    ChunkingSettings settings);
+
+  /**
+   * \brief Collapse repeated lines of every document before tokenizing it
+   * \param settings When lines and blocks count as repeated
+   */
+  void enable_deduplication(DedupSettings settings);
+
+  /**
+   * \brief Prepare the document tokens for summarization
+   * \details Collapses repeated lines if enabled, tokenizes the document and
+   * cuts it down to the token budget if it is over it.
+   * \param document The document to tokenize
+   * \param stats The stats to fill the document counts in
+   * \return The document tokens
+   * \throw std::runtime_error if the document cannot be tokenized
+   */
+  std::vector<llama_token> tokenize_document(const std::string_view document,
+                                             SummaryStats &stats) const;
+
+  /**
+   * \brief Estimate the memory needed to summarize a document
+   * \details A document that fits into a single prompt needs one context of
+   * its size. Larger documents need a context per chunk summarized at the
+   * same time, each holding a whole chunk, see Model::estimate_memory.
+   * \param number_of_tokens The number of document tokens, see
+   * tokenize_document
+   * \return The estimate of all contexts in use at the same time
+   */
+  MemoryEstimate estimate_memory(const std::size_t number_of_tokens) const;
+
+  /**
+   * \brief Summarize the document
+   * \details Only the final summary is written to out, intermediate chunk
+   * summaries are kept in memory.
+   * \param document The document to summarize
+   * \param out The output stream to write the summary to
+   * \return The token counts and timings of the summarization
+   * \throw std::runtime_error if the summarization fails
+   */
+  SummaryStats summarize(const std::string_view document, std::ostream &out);
+
+  /**
+   * \brief Summarize the document, continuing from the previous run of a
+   * named session
+   * \details If the document fits into a single prompt, only its tokens
+   * after the longest common prefix with the previous run are evaluated,
+   * see Model::generate_response. Larger documents are summarized chunk by
+   * chunk without the session.
+   * \param document The document to summarize
+   * \param out The output stream to write the summary to
+   * \param session_path The session file, empty for none
+   * \return The token counts and timings of the summarization
+   * \throw std::runtime_error if the summarization fails
+   */
+  SummaryStats summarize(const std::string_view document, std::ostream &out,
+                         const std::filesystem::path &session_path);
+
+  /**
+   * \brief Summarize a document that is tokenized already
+   * \param tokens The document tokens, see tokenize_document
+   * \param stats The stats filled in by tokenize_document
+   * \param out The output stream to write the summary to
+   * \return The stats with the generated responses added
+   * \throw std::runtime_error if the summarization fails
+   */
+  SummaryStats summarize_tokens(std::vector<llama_token> tokens,
+                                SummaryStats stats, std::ostream &out);
+
+  /**
+   * \brief Summarize the document while it is being read
+   * \details The input is read line by line and tokenized in blocks at
+   * line starts, where tokenizers do not merge across the split. The tokens
+   * go into the prefill as they arrive and the end of the prompt is added
+   * at the end of the input, so only the last block is left to evaluate
+   * then. Documents that outgrow a single prompt are read completely and
+   * summarized chunk by chunk, only the text after the blocks tokenized so
+   * far is tokenized then.
+   * \param in The input stream of the document
+   * \param out The output stream to write the summary to
+   * \return The token counts and timings of the summarization
+   * \throw std::runtime_error if the summarization fails
+   */
+  SummaryStats summarize_stream(std::istream &in, std::ostream &out);
+
+  /**
+   * \brief Summarize the latest part of an input that keeps growing
+   * \details Lines are read in the background and evaluated in one
+   * long-lived context as they arrive. When the context is full, the oldest
+   * lines are dropped from it while the system prompt stays, see
+   * Model::generate_rolling. A summary of the lines in the context is
+   * written every summary_lines new lines or summary_interval seconds,
+   * whichever comes first, and once more when the input ends.
+   * \param in The input stream to follow
+   * \param out The output stream to write the summaries to
+   * \param settings When to write summaries
+   * \param on_summary Called with the stats of every summary, may be empty
+   * \throw std::runtime_error if the chat template does not keep the
+   * document as a single piece, or the summarization fails
+   */
+  void follow(std::istream &in, std::ostream &out,
+              const FollowSettings &settings,
+              const std::function<void(const GenerationStats &stats)>
+                  &on_summary);
+
+  /**
+   * \brief Wrap the text with the summary prompts and the chat template
+   * \param text The text to summarize
+   * \return The formatted prompt
+   */
+  std::string format_prompt(const std::string_view text) const;
+
+  /**
+   * \brief Get the formatted prompt up to the start of the document
+   * \details This part is the same for every document and chunk, so its
+   * state can be cached.
+   * \return The prompt prefix, empty if the chat template does not keep the
+   * document as a single piece
+   */
+  std::string get_prompt_prefix() const;
+
+  /**
+   * \brief Get the builder of the summary prompts
+   * \return The prompt builder
+   */
+  const PromptBuilder &get_prompt_builder() const;
+
+  /**
+   * \brief Get the maximum number of document tokens per chunk
+   * \return The chunk size in tokens
+   */
+  std::size_t get_chunk_tokens() const;
+
+  /**
+   * \brief Get the context size needed to summarize a single chunk
+   * \return The chunk size plus the prompt and prediction tokens
+   */
+  std::size_t get_sequence_capacity() const;
+};
+} // namespace model_wrapper
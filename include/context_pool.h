@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: context_pool.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "llama-cpp.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Pool of contexts reused across generations
+ * \details Contexts are grouped into buckets by their capacity, which is the
+ * requested size rounded up to a power of two. A released context keeps its
+ * KV cache allocation and compute graphs, only its memory content is
+ * cleared. Each context comes with its own sampler which is reset on
+ * release, so no penalty history leaks into the next generation. Idle
+ * contexts are limited per bucket and by their total size over all
+ * buckets, the least recently released ones are freed first.
+ */
+class ContextPool {
+public:
+  /**
+   * \brief Creates a context with the given number of tokens
+   */
+  using ContextFactory = std::function<llama_context_ptr(std::size_t)>;
+
+  /**
+   * \brief A context and sampler borrowed from the pool
+   * \details Returned to the pool when destroyed.
+   */
+  class Lease {
+  private:
+    ContextPool *m_pool;
+    std::size_t m_capacity;
+    llama_context_ptr m_context;
+    llama_sampler_ptr m_sampler;
+
+  public:
+    /**
+     * \brief Construct a new Lease object
+     * \param pool The pool to return to
+     * \param capacity The bucket of the context
+     * \param context The context
+     * \param sampler The sampler
+     */
+    Lease(ContextPool *pool, const std::size_t capacity,
+          llama_context_ptr context, llama_sampler_ptr sampler);
+    ~Lease();
+    Lease(Lease &&other) noexcept = default;
+    Lease &operator=(Lease &&other) = delete;
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+    /**
+     * \brief Get the context
+     * \return The context, empty on the first use
+     */
+    llama_context *get_context() const;
+
+    /**
+     * \brief Get the sampler
+     * \return The sampler in its initial state
+     */
+    llama_sampler *get_sampler() const;
+  };
+
+private:
+  /**
+   * \brief An idle context with its sampler
+   */
+  struct Entry {
+    llama_context_ptr context;
+    llama_sampler_ptr sampler;
+    std::uint64_t release_order{0U};
+  };
+
+  const ContextFactory m_create_context;
+  const llama_sampler *const m_sampler_template;
+  const std::size_t m_max_idle_per_bucket;
+  const std::size_t m_max_idle_tokens;
+  const std::size_t m_max_capacity;
+  std::map<std::size_t, std::vector<Entry>> m_idle;
+  std::size_t m_idle_tokens{0U};
+  std::uint64_t m_number_of_releases{0U};
+  std::atomic<bool> m_is_used{false};
+  std::mutex m_mutex;
+
+  /**
+   * \brief Remove the least recently released idle contexts until the idle
+   * contexts fit into the token limit
+   * \return The removed entries, freed by the caller outside of the lock
+   */
+  std::vector<Entry> evict_idle();
+
+  /**
+   * \brief Put the context back into its bucket
+   * \param capacity The bucket of the context
+   * \param context The context
+   * \param sampler The sampler
+   */
+  void release(const std::size_t capacity, llama_context_ptr context,
+               llama_sampler_ptr sampler);
+
+public:
+  /**
+   * \brief Construct a new ContextPool object
+   * \param create_context Creates a context for a bucket
+   * \param sampler_template Sampler chain cloned for every new context, must
+   * outlive the pool
+   * \param max_idle_per_bucket Idle contexts kept per bucket, more are freed
+   * \param max_idle_tokens Total capacity of the idle contexts over all
+   * buckets, the least recently released ones beyond it are freed
+   * \param max_capacity Buckets are not rounded up beyond this size
+   */
+  ContextPool(ContextFactory create_context,
+              const llama_sampler *sampler_template,
+              const std::size_t max_idle_per_bucket,
+              const std::size_t max_idle_tokens,
+              const std::size_t max_capacity);
+
+  /**
+   * \brief Get the bucket of the contexts for a number of tokens
+   * \param number_of_tokens The required context size
+   * \return The context size the bucket is created with
+   */
+  std::size_t get_capacity(const std::size_t number_of_tokens) const;
+
+  /**
+   * \brief Borrow a context that holds at least the given number of tokens
+   * \param number_of_tokens The required context size
+   * \return The lease of the context
+   * \throw std::runtime_error if a new context cannot be created
+   */
+  Lease acquire(const std::size_t number_of_tokens);
+
+  /**
+   * \brief Check if a context was ever borrowed from the pool
+   * \details Leases refer to their pool, so a used pool must outlive them.
+   * \return true if acquire was called
+   */
+  bool is_used() const;
+
+  /**
+   * \brief Free all idle contexts
+   */
+  void clear();
+};
+} // namespace model_wrapper
@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: cpu_placement.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "llama-cpp.h"
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Parse a CPU list such as "0-15,32-47"
+ * \param cpu_list Comma separated CPU numbers and inclusive ranges
+ * \return The CPU numbers in ascending order without duplicates
+ * \throw std::invalid_argument if the list is malformed or empty
+ */
+std::vector<int> parse_cpu_list(const std::string_view cpu_list);
+
+/**
+ * \brief Restrict the process to the given CPUs
+ * \details Threads inherit the affinity of the thread that starts them, so
+ * this is called before the model is loaded and any compute thread exists.
+ * \param cpus The CPU numbers
+ * \throw std::runtime_error if the affinity cannot be set
+ */
+void set_cpu_affinity(const std::vector<int> &cpus);
+
+/**
+ * \brief Get the number of CPUs the process may run on
+ * \return The number of CPUs in the affinity mask, at least 1
+ */
+std::size_t get_available_cpus();
+
+/**
+ * \brief Parse a NUMA placement strategy
+ * \param strategy One of "none", "distribute", "isolate", "numactl" or
+ * "mirror"
+ * \return The strategy for llama_numa_init
+ * \throw std::invalid_argument if the strategy is unknown
+ */
+ggml_numa_strategy parse_numa_strategy(const std::string_view strategy);
+} // namespace model_wrapper
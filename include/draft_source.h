@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: draft_source.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "context_pool.h"
+#include "llama-cpp.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Settings for speculative decoding
+ */
+struct SpeculativeSettings {
+  /**
+   * \brief Number of tokens drafted for the first verification
+   */
+  std::size_t initial_draft_tokens{4U};
+
+  /**
+   * \brief Upper limit of the adaptive number of drafted tokens
+   */
+  std::size_t max_draft_tokens{16U};
+
+  /**
+   * \brief Longest n-gram looked up in the prompt for prompt lookup
+   */
+  std::size_t max_ngram_size{4U};
+
+  /**
+   * \brief Shortest n-gram looked up in the prompt for prompt lookup
+   */
+  std::size_t min_ngram_size{2U};
+};
+
+/**
+ * \brief Proposes the tokens that are likely to follow, for speculative
+ * decoding
+ * \details The proposals are verified by the target model in a single
+ * decode, so a source only affects the speed, never the generated text. A
+ * source belongs to one generation.
+ */
+class DraftSource {
+public:
+  virtual ~DraftSource() = default;
+
+  /**
+   * \brief Propose the next tokens
+   * \param history The prompt and the generated tokens so far, the last
+   * token is not evaluated by the target model yet
+   * \param max_tokens The maximum number of tokens to propose
+   * \param drafted The vector to append the proposed tokens to
+   * \throw std::runtime_error if drafting fails
+   */
+  virtual void draft(const std::span<const llama_token> history,
+                     const std::size_t max_tokens,
+                     std::vector<llama_token> &drafted) = 0;
+};
+
+/**
+ * \brief Drafts tokens greedily with a small model sharing the vocabulary
+ * \details The draft context keeps the tokens it evaluated. On every call
+ * only the part of the history that differs from them is evaluated, i.e.
+ * the whole prompt on the first call and the accepted tokens after that.
+ */
+class DraftModelSource : public DraftSource {
+private:
+  ContextPool::Lease m_lease;
+  std::vector<llama_token> m_evaluated;
+
+  /**
+   * \brief Evaluate tokens in slices of at most n_batch tokens
+   * \param tokens The tokens to evaluate
+   * \throw std::runtime_error if decoding fails
+   */
+  void decode(std::span<llama_token> tokens);
+
+public:
+  /**
+   * \brief Construct a new DraftModelSource object
+   * \param lease The context of the draft model, with a greedy sampler
+   */
+  explicit DraftModelSource(ContextPool::Lease lease);
+
+  void draft(const std::span<const llama_token> history,
+             const std::size_t max_tokens,
+             std::vector<llama_token> &drafted) override;
+};
+
+/**
+ * \brief Drafts the tokens that follow the latest n-gram of the output in
+ * the prompt
+ * \details Summaries copy phrases from the document, so whenever the last
+ * generated tokens also appear in the prompt, the tokens after them there
+ * are likely to come next. The prompt is indexed once by the hash of every
+ * n-gram, the longest matching n-gram wins and its last occurrence in the
+ * prompt is used. No model and no copy of the prompt is kept, the
+ * continuations are read from the history which starts with the prompt.
+ */
+class PromptLookupSource : public DraftSource {
+private:
+  const std::size_t m_prompt_size;
+  const std::size_t m_max_ngram_size;
+  const std::size_t m_min_ngram_size;
+  std::unordered_map<std::uint64_t, std::size_t> m_ngram_ends;
+
+  /**
+   * \brief Hash an n-gram, n-grams of different sizes never share a hash
+   * \param ngram The tokens of the n-gram
+   * \return The hash value
+   */
+  static std::uint64_t hash_ngram(const std::span<const llama_token> ngram);
+
+public:
+  /**
+   * \brief Construct a new PromptLookupSource object
+   * \param prompt The prompt tokens to index
+   * \param settings The n-gram sizes to look up
+   * \throw std::invalid_argument if the n-gram sizes are invalid
+   */
+  PromptLookupSource(const std::span<const llama_token> prompt,
+                     const SpeculativeSettings &settings);
+
+  void draft(const std::span<const llama_token> history,
+             const std::size_t max_tokens,
+             std::vector<llama_token> &drafted) override;
+};
+} // namespace model_wrapper
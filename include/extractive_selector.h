@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: extractive_selector.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "model.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief The part of a document kept by the extractive selection
+ */
+struct Selection {
+  /**
+   * \brief The selected spans in their original order
+   */
+  std::string text;
+
+  /**
+   * \brief Number of sentences and lines the document was split into
+   */
+  std::size_t number_of_spans{0U};
+
+  /**
+   * \brief Number of spans in the selected text
+   */
+  std::size_t number_of_selected_spans{0U};
+
+  /**
+   * \brief Sum of the token counts of the selected spans
+   */
+  std::size_t selected_tokens{0U};
+};
+
+/**
+ * \brief Picks the most informative sentences of a document that fit a token
+ * budget
+ * \details The document is split into sentences and lines, and their words
+ * are counted over a hashed vocabulary. Every span is scored by the cosine
+ * similarity of its TF-IDF vector with the TF-IDF vector of the rest of the
+ * document, so spans about what the document is mostly about rank first.
+ * The best spans are taken until the budget is used up and are kept in
+ * document order. The token counts of the spans come from the tokens of the
+ * whole document, so no span is tokenized again.
+ */
+class ExtractiveSelector {
+private:
+  const Model &m_model;
+
+public:
+  /**
+   * \brief Construct a new ExtractiveSelector object
+   * \param model The model whose token pieces the spans are counted with
+   */
+  explicit ExtractiveSelector(const Model &model);
+
+  /**
+   * \brief Select the spans of the document that fit the budget
+   * \details Tokens can merge where spans are joined, so the selected text
+   * can tokenize slightly differently than the sum of its spans.
+   * \param document The document to select from
+   * \param tokens The tokens of the whole document, without special tokens
+   * \param token_budget The maximum number of tokens to select
+   * \return The selected text and its counts
+   */
+  Selection select(const std::string_view document,
+                   const std::vector<llama_token> &tokens,
+                   const std::size_t token_budget) const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: hash.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace model_wrapper {
+/**
+ * \brief Hash bytes with the 64 bit xxHash algorithm
+ * \details Hashes can be chained by passing the previous hash as the seed.
+ * \param data The bytes to hash
+ * \param seed The seed of the hash
+ * \return The hash value
+ */
+std::uint64_t hash_bytes(const std::string_view data,
+                         const std::uint64_t seed = 0U);
+
+/**
+ * \brief Identify a file without reading all of it
+ * \details Combines the size, the modification time and the first and last
+ * megabyte of the file, which is enough to tell model files apart while
+ * staying cheap for multi gigabyte files.
+ * \param path The path to the file
+ * \return The fingerprint of the file
+ * \throw std::runtime_error if the file cannot be read
+ */
+std::uint64_t fingerprint_file(const std::string &path);
+
+/**
+ * \brief Format a hash as a fixed width hexadecimal string
+ * \param hash The hash value
+ * \return 16 hexadecimal digits
+ */
+std::string to_hex(const std::uint64_t hash);
+} // namespace model_wrapper
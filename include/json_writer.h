@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: json_writer.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace model_wrapper {
+/**
+ * \brief Minimal writer for a flat JSON object on a single line
+ */
+class JsonWriter {
+private:
+  std::string m_buffer{"{"};
+
+  /**
+   * \brief Append the key and the separators before a value
+   * \param key The key of the value
+   */
+  void append_key(const std::string_view key);
+
+public:
+  /**
+   * \brief Escape a string to be placed between JSON quotes
+   * \param text The text to escape
+   * \return The escaped text
+   */
+  static std::string escape(const std::string_view text);
+
+  /**
+   * \brief Add a string value
+   * \param key The key of the value
+   * \param value The value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add(const std::string_view key, const std::string_view value);
+
+  /**
+   * \brief Add a string value
+   * \param key The key of the value
+   * \param value The value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add(const std::string_view key, const char *value);
+
+  /**
+   * \brief Add an integer value
+   * \param key The key of the value
+   * \param value The value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add(const std::string_view key, const std::int64_t value);
+
+  /**
+   * \brief Add an unsigned integer value
+   * \param key The key of the value
+   * \param value The value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add(const std::string_view key, const std::uint64_t value);
+
+  /**
+   * \brief Add a floating point value
+   * \param key The key of the value
+   * \param value The value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add(const std::string_view key, const double value);
+
+  /**
+   * \brief Add a boolean value
+   * \param key The key of the value
+   * \param value The value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add(const std::string_view key, const bool value);
+
+  /**
+   * \brief Add an already serialized JSON value, e.g. a nested object
+   * \param key The key of the value
+   * \param json The serialized value
+   * \return Reference to this writer for method chaining
+   */
+  JsonWriter &add_raw(const std::string_view key, const std::string_view json);
+
+  /**
+   * \brief Get the serialized object
+   * \return The JSON object without a trailing newline
+   */
+  std::string str() const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: log_deduplicator.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace model_wrapper {
+/**
+ * \brief Settings for collapsing repeated lines
+ */
+struct DedupSettings {
+  /**
+   * \brief Maximum number of differing simhash bits for two lines to count
+   * as near duplicates, 0 only collapses lines that are equal after
+   * normalization
+   */
+  std::size_t max_distance{3U};
+
+  /**
+   * \brief Longest block of lines that is detected as repeating
+   */
+  std::size_t max_block_lines{8U};
+
+  /**
+   * \brief Number of threads hashing lines, 0 uses all hardware threads
+   */
+  std::size_t number_of_threads{0U};
+};
+
+/**
+ * \brief Result of collapsing the repeated lines of a text
+ */
+struct DedupResult {
+  /**
+   * \brief The text with repeats collapsed
+   */
+  std::string text;
+
+  /**
+   * \brief Number of lines in the input
+   */
+  std::size_t input_lines{0U};
+
+  /**
+   * \brief Number of lines in the result, including the repeat markers
+   */
+  std::size_t output_lines{0U};
+};
+
+/**
+ * \brief Collapses repeated and near-duplicate lines and blocks of log-style
+ * text
+ * \details Lines are compared after normalization: words with digits
+ * (timestamps, IDs, addresses, counters) all hash the same and whitespace
+ * does not matter. A run of lines that are equal after normalization, or
+ * whose simhashes differ in at most max_distance bits, is kept as its first
+ * line with a repeat count. A block of up to max_block_lines lines that repeats
+ * right after itself is kept once with a line telling how often it
+ * repeated. Lines are hashed in parallel in fixed size segments and the
+ * runs are collapsed in order, so the result does not depend on the number
+ * of threads. Only the kept lines are copied to the result.
+ */
+class LogDeduplicator {
+private:
+  const DedupSettings m_settings;
+
+public:
+  /**
+   * \brief Construct a new LogDeduplicator object
+   * \param settings When lines and blocks count as repeated
+   */
+  explicit LogDeduplicator(DedupSettings settings);
+
+  /**
+   * \brief Collapse the repeats in the text
+   * \param text The text to deduplicate
+   * \return The collapsed text and its line counts
+   */
+  DedupResult deduplicate(const std::string_view text) const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: mapped_file.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+namespace model_wrapper {
+/**
+ * \brief Read-only memory mapping of a whole file
+ * \details The content is paged in by the kernel on access, so large inputs
+ * are not copied to the heap before tokenization.
+ */
+class MappedFile {
+private:
+  void *m_data{nullptr};
+  std::size_t m_size{0U};
+
+public:
+  /**
+   * \brief Map the file
+   * \param path The file to map
+   * \throw std::runtime_error if the file cannot be opened or mapped
+   */
+  explicit MappedFile(const std::filesystem::path &path);
+  ~MappedFile();
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) = delete;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * \brief Get the content of the file
+   * \return View of the mapped content, valid as long as this object lives
+   */
+  std::string_view get_view() const;
+};
+} // namespace model_wrapper
@@ -9,23 +9,422 @@
 //   github: github.com/onurozuduru
 ///////////////////////////////////////////////////////////////////////////////
 
+#pragma once
+
+#include "context_pool.h"
+#include "draft_source.h"
 #include "llama-cpp.h"
+#include "piece_table.h"
+#include "prefix_cache.h"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <ostream>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace model_wrapper {
+/**
+ * \brief Token counts and timings of a generated response
+ */
+struct GenerationStats {
+  /**
+   * \brief Number of tokens in the prompt
+   */
+  std::size_t prompt_tokens{0U};
+
+  /**
+   * \brief Number of prompt tokens restored from the prefix cache
+   */
+  std::size_t cached_tokens{0U};
+
+  /**
+   * \brief Number of generated tokens
+   */
+  std::size_t generated_tokens{0U};
+
+  /**
+   * \brief Time spent tokenizing the prompt in milliseconds
+   */
+  double tokenize_ms{0.0};
+
+  /**
+   * \brief Time spent getting a context from the pool or creating it in
+   * milliseconds
+   */
+  double context_ms{0.0};
+
+  /**
+   * \brief Time from the start until the prompt is evaluated in milliseconds
+   */
+  double prefill_ms{0.0};
+
+  /**
+   * \brief Time spent generating tokens in milliseconds
+   */
+  double decode_ms{0.0};
+
+  /**
+   * \brief Part of the decode time spent converting tokens to text and
+   * writing them in milliseconds
+   */
+  double output_ms{0.0};
+
+  /**
+   * \brief Prompt evaluation time measured by llama.cpp in milliseconds
+   * \details The llama.cpp counters are per context, so they are not set
+   * for batched responses that share one.
+   */
+  double llama_prompt_eval_ms{0.0};
+
+  /**
+   * \brief Number of prompt tokens evaluated by llama.cpp
+   */
+  std::size_t llama_prompt_eval_tokens{0U};
+
+  /**
+   * \brief Generation time measured by llama.cpp in milliseconds
+   */
+  double llama_eval_ms{0.0};
+
+  /**
+   * \brief Number of tokens generated by llama.cpp
+   */
+  std::size_t llama_eval_tokens{0U};
+
+  /**
+   * \brief Size of the context in tokens, the largest one when accumulated
+   */
+  std::size_t context_size{0U};
+
+  /**
+   * \brief Size of the sequence state in the KV cache at the end of the
+   * response in bytes, the largest one when accumulated
+   */
+  std::size_t kv_bytes{0U};
+
+  /**
+   * \brief Time from the start until the first token is written in
+   * milliseconds
+   */
+  double time_to_first_token_ms{0.0};
+
+  /**
+   * \brief Time between consecutive generated tokens in milliseconds
+   */
+  std::vector<double> token_latencies_ms{};
+
+  /**
+   * \brief Number of decodes of the model that produced generated tokens
+   * \details Without speculative decoding every decode produces at most one
+   * token, so the generated tokens per decode are the effective speedup.
+   */
+  std::size_t target_decodes{0U};
+
+  /**
+   * \brief Number of tokens proposed by the draft source
+   */
+  std::size_t draft_tokens{0U};
+
+  /**
+   * \brief Number of proposed tokens that matched the sampled ones
+   */
+  std::size_t accepted_draft_tokens{0U};
+
+  /**
+   * \brief Accumulate the stats of another response
+   * \param other The stats to add
+   * \return Reference to this object
+   */
+  GenerationStats &operator+=(const GenerationStats &other);
+};
+
+/**
+ * \brief Settings applied to every context created by the model
+ */
+struct ContextSettings {
+  /**
+   * \brief Maximum number of prompt tokens submitted in one decode
+   */
+  std::uint32_t n_batch{2048U};
+
+  /**
+   * \brief Maximum number of tokens computed at once inside a decode, the
+   * compute buffers are sized by this
+   */
+  std::uint32_t n_ubatch{512U};
+
+  /**
+   * \brief Maximum number of idle contexts kept per pool bucket
+   */
+  std::size_t max_idle_contexts{4U};
+
+  /**
+   * \brief Maximum total size of the idle contexts over all pool buckets in
+   * tokens, the least recently used ones beyond it are freed, 0 allows
+   * twice the trained context size
+   */
+  std::size_t max_idle_tokens{0U};
+
+  /**
+   * \brief Number of threads for generating tokens, 0 keeps the llama.cpp
+   * default
+   */
+  std::uint32_t n_threads{0U};
+
+  /**
+   * \brief Number of threads for evaluating prompts, 0 keeps the llama.cpp
+   * default
+   */
+  std::uint32_t n_threads_batch{0U};
+
+  /**
+   * \brief Type of the cached keys, quantized types take less memory
+   */
+  ggml_type type_k{GGML_TYPE_F16};
+
+  /**
+   * \brief Type of the cached values, quantized types need flash attention
+   */
+  ggml_type type_v{GGML_TYPE_F16};
+
+  /**
+   * \brief Whether attention is computed in tiles instead of through the
+   * full score matrix, auto lets llama.cpp decide for the device
+   */
+  llama_flash_attn_type flash_attention{LLAMA_FLASH_ATTN_TYPE_AUTO};
+};
+
+/**
+ * \brief Settings for loading the model weights
+ */
+struct LoadSettings {
+  /**
+   * \brief Map the model file instead of reading it, the weights are then
+   * paged in on use and shared with other processes
+   */
+  bool is_memory_mapped{true};
+
+  /**
+   * \brief Lock the weights in RAM so they are never swapped out
+   */
+  bool is_memory_locked{false};
+
+  /**
+   * \brief Load only the vocabulary, for tokenizing without the weights
+   */
+  bool is_vocab_only{false};
+};
+
+/**
+ * \brief Memory needed to summarize a document, estimated before any context
+ * is created
+ */
+struct MemoryEstimate {
+  /**
+   * \brief Number of tokens each context holds
+   */
+  std::size_t context_size{0U};
+
+  /**
+   * \brief Number of contexts in use at the same time
+   */
+  std::size_t number_of_contexts{0U};
+
+  /**
+   * \brief Bytes of the K and V caches of all contexts
+   */
+  std::size_t kv_bytes{0U};
+
+  /**
+   * \brief Bytes of the compute buffers of all contexts
+   */
+  std::size_t compute_bytes{0U};
+
+  /**
+   * \brief Bytes of the model weights, shared by all contexts
+   */
+  std::size_t weights_bytes{0U};
+};
+
+/**
+ * \brief Parse the type of a K or V cache
+ * \param name The type name, e.g. f16, q8_0 or q4_0
+ * \return The cache type
+ * \throw std::invalid_argument if the type cannot be used for a cache
+ */
+ggml_type parse_cache_type(const std::string_view name);
+
+/**
+ * \brief Parse the flash attention setting
+ * \param name One of on, off or auto
+ * \return The flash attention setting
+ * \throw std::invalid_argument if the name is unknown
+ */
+llama_flash_attn_type parse_flash_attention(const std::string_view name);
+
+/**
+ * \brief Settings of the sampler chain besides the temperature
+ */
+struct SamplerSettings {
+  /**
+   * \brief Number of most likely tokens kept
+   */
+  int32_t top_k{35};
+
+  /**
+   * \brief Minimum probability relative to the most likely token
+   */
+  float min_p{0.3f};
+
+  /**
+   * \brief Minimum number of tokens kept by min-p
+   */
+  std::size_t min_keep{2U};
+
+  /**
+   * \brief Number of last tokens the penalties look at
+   */
+  int32_t penalty_last_n{128};
+
+  /**
+   * \brief Penalty for repeated tokens
+   */
+  float repeat_penalty{1.5f};
+
+  /**
+   * \brief Penalty growing with the frequency of a token
+   */
+  float frequency_penalty{0.7f};
+
+  /**
+   * \brief Penalty for tokens that appeared at all
+   */
+  float presence_penalty{0.7f};
+
+  /**
+   * \brief Seed of the distribution sampler
+   */
+  std::uint32_t seed{LLAMA_DEFAULT_SEED};
+
+  /**
+   * \brief Describe the settings as text, e.g. for cache keys
+   * \return Every setting as name=value
+   */
+  std::string describe() const;
+};
+
+/**
+ * \brief Timings of a prompt evaluation and token generation with a given
+ * number of threads
+ */
+struct ThreadTimings {
+  /**
+   * \brief Time to evaluate the prompt in milliseconds
+   */
+  double prefill_ms{0.0};
+
+  /**
+   * \brief Time to generate the tokens in milliseconds
+   */
+  double decode_ms{0.0};
+};
+
+/**
+ * \brief A prompt for batched generation together with its output sinks
+ */
+struct SequenceRequest {
+  /**
+   * \brief The prompt to respond to
+   */
+  std::string prompt;
+
+  /**
+   * \brief The tokens of the prompt, if set the prompt text is not used
+   */
+  std::vector<llama_token> prompt_tokens;
+
+  /**
+   * \brief Called with each generated piece of text
+   */
+  std::function<void(std::string_view piece)> on_piece;
+
+  /**
+   * \brief Called once the response is complete
+   */
+  std::function<void(const GenerationStats &stats)> on_finished;
+
+  /**
+   * \brief Called instead of on_finished if the prompt cannot be processed,
+   * if not set the error is thrown
+   */
+  std::function<void(const std::string &message)> on_error;
+};
+
+/**
+ * \brief Provides the next request for batched generation, std::nullopt when
+ * there are no more requests
+ */
+using SequenceRequestSource = std::function<std::optional<SequenceRequest>()>;
+
+/**
+ * \brief Appends the next prompt tokens to the vector, returns false once
+ * the prompt is complete
+ */
+using TokenSource = std::function<bool(std::vector<llama_token> &tokens)>;
+
+/**
+ * \brief What happened in rolling generation since the last call
+ */
+struct RollingUpdate {
+  /**
+   * \brief The input ended, no more tokens will come
+   */
+  bool is_finished{false};
+
+  /**
+   * \brief A summary of the current window is due after the new tokens
+   */
+  bool is_summary_due{false};
+};
+
+/**
+ * \brief Appends the next document tokens for rolling generation, may block
+ * until there are any
+ */
+using RollingSource =
+    std::function<RollingUpdate(std::vector<llama_token> &tokens)>;
+
 /**
  * \brief Model wrapper
  */
 class Model {
 private:
+  const std::string m_model_path;
   const float m_temperature;
   const std::size_t m_prediction_length;
+  const SamplerSettings m_sampler_settings{};
+  double m_load_ms{0.0};
 
   llama_model_ptr m_model{nullptr};
   const llama_vocab *m_vocab;
+  bool m_is_split_safe{false};
+  std::unique_ptr<PieceTable> m_piece_table{nullptr};
   llama_sampler_ptr m_sampler{nullptr};
+  std::unique_ptr<PrefixCache> m_prefix_cache{nullptr};
+  ContextSettings m_context_settings{};
+  std::unique_ptr<ContextPool> m_context_pool{nullptr};
+
+  llama_model_ptr m_draft_model{nullptr};
+  llama_sampler_ptr m_draft_sampler{nullptr};
+  std::unique_ptr<ContextPool> m_draft_pool{nullptr};
+  SpeculativeSettings m_speculative_settings{};
+  bool m_is_prompt_lookup_enabled{false};
 
   /**
    * \brief Tokenize the prompt
@@ -33,22 +432,217 @@ private:
    * \return The tokens
    * \throw std::runtime_error if the prompt cannot be tokenized
    */
-  std::vector<llama_token> tokenize_prompt(const std::string &prompt);
+  std::vector<llama_token> tokenize_prompt(const std::string_view prompt);
+
+  /**
+   * \brief Tokenize a text
+   * \param text The text to tokenize
+   * \param is_adding_special_tokens Add BOS/EOS tokens as the model expects
+   * \param is_parsing_special_tokens Parse special tokens in the text
+   * \return The tokens
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  std::vector<llama_token>
+  tokenize(const std::string_view text, const bool is_adding_special_tokens,
+           const bool is_parsing_special_tokens) const;
+
+  /**
+   * \brief Tokenize a text and append the tokens
+   * \details The tokens are written straight into the vector, which is
+   * grown by an upper estimate first. Only if the estimate is too small the
+   * text is tokenized a second time.
+   * \param text The text to tokenize
+   * \param is_adding_special_tokens Add BOS/EOS tokens as the model expects
+   * \param is_parsing_special_tokens Parse special tokens in the text
+   * \param tokens The tokens to append to
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  void tokenize_into(const std::string_view text,
+                     const bool is_adding_special_tokens,
+                     const bool is_parsing_special_tokens,
+                     std::vector<llama_token> &tokens) const;
 
   /**
    * \brief Initialize the sampler
    */
   void initialize_sampler();
 
+  /**
+   * \brief Apply the context settings to the context parameters
+   * \details The batch sizes are capped by the context size, so n_ctx must
+   * be set before.
+   * \param context_params The parameters to update
+   */
+  void apply_context_settings(llama_context_params &context_params) const;
+
+  /**
+   * \brief Evaluate tokens in slices of at most n_batch tokens
+   * \param context The context to evaluate the tokens in
+   * \param tokens The tokens to evaluate
+   * \throw std::runtime_error if decoding fails
+   */
+  void decode_tokens(llama_context *context,
+                     const std::span<llama_token> tokens) const;
+
   /**
    * \brief Create the context.
-   * \details The context size is determined as
-   * number_of_tokens + m_prediction_length.
-   * \param number_of_tokens The number of tokens
+   * \param model The model to create the context for, the target or the
+   * draft model
+   * \param context_size The number of tokens the context holds
    * \return The context pointer
    * \throw std::runtime_error if the context cannot be created
    */
-  llama_context_ptr create_context(const std::size_t number_of_tokens);
+  llama_context_ptr create_context(llama_model *model,
+                                   const std::size_t context_size);
+
+  /**
+   * \brief Replace the context pools, e.g. after the settings changed
+   * \throw std::runtime_error if a context was already borrowed from them
+   */
+  void reset_context_pool();
+
+  /**
+   * \brief Check that the context pools can be replaced
+   * \details Leases return their context to the pool they came from, so a
+   * pool is never replaced once it handed out a context.
+   * \throw std::runtime_error if a context was already borrowed
+   */
+  void check_context_pool_unused() const;
+
+  /**
+   * \brief Bring the context to the state after the cached prompt prefix
+   * \details If the tokens start with the cached prefix, the prefix state is
+   * restored from the cache. On a cache miss the prefix is evaluated and
+   * stored for later calls.
+   * \param context The empty context
+   * \param tokens The prompt tokens
+   * \return The number of prompt tokens already in the context
+   * \throw std::runtime_error if the prefix cannot be evaluated
+   */
+  std::size_t restore_prefix(llama_context *context,
+                             std::vector<llama_token> &tokens);
+
+  /**
+   * \brief Bring the context to the state of the previous run of a session
+   * \details The stored state is kept up to the longest common prefix of
+   * its tokens and the prompt, the diverging tail is dropped.
+   * \param context The empty context
+   * \param session_path The session file
+   * \param tokens The prompt tokens
+   * \return The number of prompt tokens already in the context, 0 if the
+   * session does not exist or cannot be loaded
+   */
+  std::size_t restore_session(llama_context *context,
+                              const std::filesystem::path &session_path,
+                              const std::vector<llama_token> &tokens) const;
+
+  /**
+   * \brief Save the prompt state of the context as a session
+   * \details Generated tokens are dropped from the context first, only the
+   * prompt can be shared with the next run. Failing to save is not an
+   * error, the next run evaluates the whole prompt then.
+   * \param context The context after the response
+   * \param session_path The session file
+   * \param prompt The prompt tokens
+   */
+  void save_session(llama_context *context,
+                    const std::filesystem::path &session_path,
+                    const std::span<const llama_token> prompt) const;
+
+  /**
+   * \brief Generate a response to the prompt tokens with a pooled context
+   * \param tokens The prompt tokens
+   * \param start_time The start of the response for the timings
+   * \param stats The stats collected before, e.g. the tokenization time
+   * \param out The output stream to write the response to
+   * \param session_path The session file to continue from and to update,
+   * empty if there is none
+   * \return The token counts and timings of the response
+   * \throw std::runtime_error if the generation fails
+   */
+  GenerationStats
+  respond_to_tokens(std::vector<llama_token> &tokens,
+                    const std::chrono::steady_clock::time_point start_time,
+                    GenerationStats stats, std::ostream &out,
+                    const std::filesystem::path &session_path = {});
+
+  /**
+   * \brief Evaluate the rest of the prompt and generate the response
+   * \param context The context holding the evaluated part of the prompt
+   * \param sampler The sampler in its initial state
+   * \param tokens The prompt tokens
+   * \param number_of_evaluated The number of prompt tokens already in the
+   * context
+   * \param start_time The start of the response for the timings
+   * \param stats The stats to complete
+   * \param out The output stream to write the response to
+   * \throw std::runtime_error if decoding fails
+   */
+  void generate_tokens(llama_context *context, llama_sampler *sampler,
+                       std::vector<llama_token> &tokens,
+                       const std::size_t number_of_evaluated,
+                       const std::chrono::steady_clock::time_point start_time,
+                       GenerationStats &stats, std::ostream &out);
+
+  /**
+   * \brief Create the draft source for one response
+   * \details The draft model takes precedence over prompt lookup.
+   * \param context_size The context size of the response
+   * \param prompt The prompt tokens of the response
+   * \return The draft source, nullptr if speculative decoding is disabled
+   * \throw std::runtime_error if the draft context cannot be created
+   */
+  std::unique_ptr<DraftSource>
+  create_draft_source(const std::size_t context_size,
+                      const std::span<const llama_token> prompt);
+
+  /**
+   * \brief Evaluate the last prompt slice and generate the response with
+   * speculative decoding
+   * \details Each step evaluates the last sampled token together with the
+   * proposals of the draft source in one batch. The sampler then samples at
+   * every position in order and a proposal is accepted as long as it equals
+   * the sampled token, so the response is sampled exactly as without
+   * proposals. The number of proposals grows while all of them are accepted
+   * and shrinks when fewer than half are.
+   * \param context The context holding all but the last prompt slice
+   * \param sampler The sampler in its initial state
+   * \param draft_source The source of the proposals
+   * \param tokens The prompt tokens, the generated tokens are appended
+   * \param number_of_evaluated The number of prompt tokens in the context
+   * \param start_time The start of the response for the timings
+   * \param stats The stats to complete
+   * \param out The output stream to write the response to
+   * \throw std::runtime_error if decoding or drafting fails
+   */
+  void generate_speculative(
+      llama_context *context, llama_sampler *sampler,
+      DraftSource &draft_source, std::vector<llama_token> &tokens,
+      const std::size_t number_of_evaluated,
+      const std::chrono::steady_clock::time_point start_time,
+      GenerationStats &stats, std::ostream &out);
+
+  /**
+   * \brief Write a generated token and record its timings
+   * \param token The token to write
+   * \param start_time The start of the response
+   * \param previous_token_time The time the previous token was written,
+   * updated to the time of this token
+   * \param stats The stats to update
+   * \param out The output stream to write the token to
+   */
+  void write_token(const llama_token token,
+                   const std::chrono::steady_clock::time_point start_time,
+                   std::chrono::steady_clock::time_point &previous_token_time,
+                   GenerationStats &stats, std::ostream &out) const;
+
+  /**
+   * \brief Convert a token to its text piece
+   * \param token The token to convert
+   * \return View of the text piece in the piece table
+   * \throw std::runtime_error if the token cannot be converted
+   */
+  std::string_view token_to_piece(const llama_token token) const;
 
 public:
   /**
@@ -57,11 +651,18 @@ public:
    * \param temperature The temperature
    * \param number_of_gpu_layers The number of GPU layers to use
    * \param prediction_length The maximum number of tokens to predict
+   * \param load_settings How the weights are loaded
    * \throw std::runtime_error if the model cannot be loaded
    */
   Model(const std::string_view model_path, const float temperature,
         const int32_t number_of_gpu_layers,
-        const std::size_t prediction_length);
+        const std::size_t prediction_length,
+        const LoadSettings &load_settings = {});
+
+  /**
+   * \brief The context pool refers back to the model, so it cannot move
+   */
+  Model(Model &&) = delete;
 
   /**
    * \brief Apply the chat template to the messages
@@ -72,14 +673,328 @@ public:
   std::string
   get_formatted_prompt(const std::vector<llama_chat_message> &messages);
 
+  /**
+   * \brief Tokenize a plain text without adding or parsing special tokens
+   * \details Used for document bodies that are later placed into a prompt.
+   * Large texts are tokenized on every available CPU, see the overload with
+   * the number of threads.
+   * \param text The text to tokenize
+   * \return The tokens
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  std::vector<llama_token> tokenize_text(const std::string_view text) const;
+
+  /**
+   * \brief Tokenize a plain text on several threads
+   * \details The text is split into shards at token boundaries, see
+   * find_token_boundary, and the shards are tokenized in parallel, each in a
+   * single pass into a buffer sized by estimate_tokens. The result is the
+   * same as tokenizing the whole text at once. Only vocabularies with a
+   * regex pre-tokenizer (BPE) are split, others are tokenized on one thread,
+   * since they can merge tokens across line breaks.
+   * \param text The text to tokenize
+   * \param number_of_threads The maximum number of threads, 1 tokenizes on
+   * the calling thread
+   * \return The tokens
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  std::vector<llama_token>
+  tokenize_text(const std::string_view text,
+                const std::size_t number_of_threads) const;
+
+  /**
+   * \brief Tokenize a plain text and append the tokens
+   * \details Same as tokenize_text, for callers that place the text tokens
+   * after other tokens in a preallocated buffer.
+   * \param text The text to tokenize
+   * \param tokens The tokens to append to
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  void tokenize_text_into(const std::string_view text,
+                          std::vector<llama_token> &tokens) const;
+
+  /**
+   * \brief Estimate the maximum number of tokens of a text
+   * \details Enough for nearly every text, tokenizers produce far fewer
+   * tokens than bytes.
+   * \param text_size The size of the text in bytes
+   * \return The estimated number of tokens
+   */
+  static std::size_t estimate_tokens(const std::size_t text_size);
+
+  /**
+   * \brief Find the last position the text can be split at without changing
+   * its tokens
+   * \details Pre-tokenizers merge runs of whitespace, but never a line break
+   * with the word that starts the next line, so the text is split right
+   * after a line break that is followed by a visible ASCII character.
+   * \param text The text to split
+   * \return The length of the first part, 0 if there is no such position
+   */
+  static std::size_t find_token_boundary(const std::string_view text);
+
+  /**
+   * \brief Tokenize a part of a formatted prompt, parsing the special tokens
+   * of the chat template
+   * \param text The text to tokenize
+   * \param is_prompt_start Add the tokens the model expects at the start of
+   * a prompt, e.g. BOS
+   * \return The tokens
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  std::vector<llama_token> tokenize_template(const std::string_view text,
+                                             const bool is_prompt_start) const;
+
+  /**
+   * \brief Convert tokens back to text
+   * \param tokens The tokens to convert
+   * \return The text
+   * \throw std::runtime_error if the tokens cannot be converted
+   */
+  std::string detokenize(const std::span<const llama_token> tokens) const;
+
+  /**
+   * \brief Get the context size the model was trained with
+   * \return The trained context size in tokens
+   */
+  std::size_t get_trained_context_size() const;
+
+  /**
+   * \brief Get the table of rendered token pieces
+   * \details Its build time and memory are not part of the load time.
+   * \return The piece table
+   */
+  const PieceTable &get_piece_table() const;
+
+  /**
+   * \brief Get the time it took to load the model
+   * \return The load time in milliseconds
+   */
+  double get_load_ms() const;
+
+  /**
+   * \brief Get the maximum number of tokens to predict per response
+   * \return The prediction length
+   */
+  std::size_t get_prediction_length() const;
+
+  /**
+   * \brief Estimate the memory of a context for a number of tokens
+   * \details The context size is rounded up the same way the context pool
+   * does. The K and V caches follow from the model shape and the cache
+   * types. The compute buffers hold the logits and activations of one
+   * ubatch and, without flash attention, its attention scores against the
+   * whole context. Auto flash attention counts as off, so the estimate
+   * errs on the high side.
+   * \param number_of_tokens The tokens the context has to hold
+   * \return The estimate for a single context
+   */
+  MemoryEstimate estimate_memory(const std::size_t number_of_tokens) const;
+
+  /**
+   * \brief Set the settings of the contexts, before the first generation
+   * \param settings The context settings
+   * \throw std::invalid_argument if a batch size is zero or the V cache is
+   * quantized while flash attention is off
+   * \throw std::runtime_error if a context was already created
+   */
+  void set_context_settings(const ContextSettings &settings);
+
+  /**
+   * \brief Get the context settings
+   * \return The context settings
+   */
+  const ContextSettings &get_context_settings() const;
+
+  /**
+   * \brief Measure prompt evaluation and token generation with a number of
+   * threads
+   * \details A pooled context evaluates the prompt and then decodes the
+   * given number of tokens one at a time. Nothing is sampled, the last
+   * prompt token is fed back, so only the compute time is measured.
+   * \param prompt The prompt tokens
+   * \param number_of_decoded The number of single token decodes
+   * \param number_of_threads The number of threads for both phases
+   * \return The timings of both phases
+   * \throw std::runtime_error if the prompt is empty or decoding fails
+   */
+  ThreadTimings measure_threads(std::vector<llama_token> prompt,
+                                const std::size_t number_of_decoded,
+                                const std::uint32_t number_of_threads);
+
+  /**
+   * \brief Evaluate a single token to take the one-time costs of the first
+   * decode
+   * \details The decode faults in the weight pages, builds the kernels of
+   * the backend and starts its threads, so the first response does not pay
+   * for them. The draft model is warmed up too if enabled.
+   * \return The time of the warmup in milliseconds
+   * \throw std::runtime_error if the context cannot be created or decoding
+   * fails
+   */
+  double warmup();
+
+  /**
+   * \brief Speculate with a small draft model sharing the vocabulary
+   * \details The draft model proposes tokens greedily and the model checks
+   * them in one decode, accepted proposals save a decode each. Batched
+   * generation does not speculate.
+   * \param model_path The path to the draft model file in GGUF format
+   * \param number_of_gpu_layers The number of GPU layers to use
+   * \param settings The number of proposals per step
+   * \param load_settings How the weights are loaded
+   * \throw std::invalid_argument if a number of proposals is zero
+   * \throw std::runtime_error if the draft model cannot be loaded, its
+   * vocabulary differs or a context was already created
+   */
+  void enable_draft_model(const std::string_view model_path,
+                          const int32_t number_of_gpu_layers,
+                          const SpeculativeSettings &settings,
+                          const LoadSettings &load_settings = {});
+
+  /**
+   * \brief Speculate with continuations copied from the prompt
+   * \details When the last generated tokens also appear in the prompt, the
+   * tokens after them are proposed and checked in one decode, see
+   * PromptLookupSource. Needs no second model, ignored if a draft model is
+   * enabled. Batched generation does not speculate.
+   * \param settings The number of proposals per step and the n-gram sizes
+   * \throw std::invalid_argument if the settings are invalid
+   */
+  void enable_prompt_lookup(const SpeculativeSettings &settings);
+
+  /**
+   * \brief Cache the state of a fixed prompt prefix on disk
+   * \details Prompts that start with the prefix skip evaluating it, the
+   * cache entry is keyed by the model file fingerprint, the cache types and
+   * flash attention of the context settings and the prefix hash.
+   * \param directory The cache directory
+   * \param prefix The prompt prefix, i.e. the formatted prompt up to the
+   * start of the user text
+   * \throw std::runtime_error if the prefix cannot be tokenized
+   */
+  void enable_prefix_cache(const std::string &directory,
+                           const std::string &prefix);
+
   /**
    * \brief Generate a responde from the prompt
    * \details The model generates a response to the prompt by sampling tokens
-   * and this function writes to out each token
+   * and this function writes to out each token. Every call borrows its own
+   * context and sampler from the context pool, so it can be called from
+   * several threads at the same time.
    * \param prompt The prompt to respond to
    * \param out The output stream to write the response to
+   * \return The token counts and timings of the response
+   * \throw std::runtime_error if the generation fails
+   */
+  GenerationStats generate_response(const std::string_view prompt,
+                                    std::ostream &out);
+
+  /**
+   * \brief Generate a response to an already tokenized prompt
+   * \details Same as generating from the prompt text, for callers that
+   * assemble the prompt from tokenized parts without building the text.
+   * \param tokens The prompt tokens, including the special tokens of the
+   * chat template
+   * \param out The output stream to write the response to
+   * \return The token counts and timings of the response
+   * \throw std::runtime_error if the generation fails
+   */
+  GenerationStats generate_response(std::vector<llama_token> tokens,
+                                    std::ostream &out);
+
+  /**
+   * \brief Generate a response to an already tokenized prompt, continuing
+   * from the previous run of a named session
+   * \details The prompt state of the previous run is loaded and kept up to
+   * the longest common token prefix with this prompt, so only the tokens
+   * after it are evaluated. When a document only grew or changed near its
+   * end, the cost follows the change instead of the document size. The
+   * prompt state of this run replaces the session afterwards.
+   * \param tokens The prompt tokens, including the special tokens of the
+   * chat template
+   * \param session_path The session file, it is created if it does not exist
+   * \param out The output stream to write the response to
+   * \return The token counts and timings of the response, the reused tokens
+   * count as cached
    * \throw std::runtime_error if the generation fails
    */
-  void generate_response(const std::string &prompt, std::ostream &out);
+  GenerationStats generate_response(std::vector<llama_token> tokens,
+                                    const std::filesystem::path &session_path,
+                                    std::ostream &out);
+
+  /**
+   * \brief Generate a response to a prompt whose tokens arrive over time
+   * \details The source is called until it reports the prompt complete.
+   * Whenever a full n_batch slice of tokens is pending, it is evaluated
+   * right away, so reading and tokenizing the input overlaps with the
+   * prefill and only the tail of the prompt is left after the last call.
+   * The context is taken from the pool in the bucket of the tokens at the
+   * first decode, and moved with its state to a larger bucket whenever the
+   * prompt outgrows it.
+   * \param next_tokens Appends the prompt tokens, including the special
+   * tokens of the chat template
+   * \param capacity The maximum number of prompt and generated tokens
+   * \param out The output stream to write the response to
+   * \return The token counts and timings of the response, std::nullopt if
+   * the prompt outgrows the capacity, the source is not called again then
+   * \throw std::runtime_error if the prompt is empty or the generation fails
+   */
+  std::optional<GenerationStats>
+  generate_streamed(const TokenSource &next_tokens, const std::size_t capacity,
+                    std::ostream &out);
+
+  /**
+   * \brief Generate responses over a rolling window of an unbounded document
+   * \details One context is kept for the whole input. The prefix is
+   * evaluated once and stays resident, the document tokens from the source
+   * are evaluated as they arrive. When the window is full, the oldest
+   * document tokens are removed from the sequence and the rest is shifted
+   * back, in steps of a quarter window so the cache is not shifted for
+   * every line. Whenever a summary is due, the suffix is evaluated after the
+   * window, the response is generated and the suffix and response are
+   * removed again. Memory stays constant however long the input is.
+   * \param prefix_tokens The tokens before the document, e.g. the system
+   * prompt
+   * \param suffix_tokens The tokens after the document
+   * \param next_tokens Provides the document tokens and when to respond
+   * \param capacity The context size in tokens
+   * \param out The output stream to write the responses to
+   * \param on_response Called with the stats of every response, may be
+   * empty
+   * \throw std::runtime_error if the context is too small or cannot shift,
+   * or decoding fails
+   */
+  void generate_rolling(
+      const std::vector<llama_token> &prefix_tokens,
+      const std::vector<llama_token> &suffix_tokens,
+      const RollingSource &next_tokens, const std::size_t capacity,
+      std::ostream &out,
+      const std::function<void(const GenerationStats &stats)> &on_response);
+
+  /**
+   * \brief Generate responses to several prompts in one context
+   * \details Every prompt is decoded as its own sequence with its own sampler
+   * and all active sequences share one batch per decode, so generating N
+   * responses costs about as many decodes as the longest response. When a
+   * sequence finishes, its memory is released and the next request from the
+   * source takes its place (continuous batching). The sequences share one
+   * cache sized for the prompts and predictions of the first requests, a
+   * request is admitted once its tokens fit next to the active ones.
+   * Smaller requests may overtake one that does not fit yet, up to
+   * number_of_sequences times, then no request is admitted before it. If a
+   * request does not fit even into the empty cache, the context is created
+   * again for the pending requests.
+   * \param next_request Provides the requests, called whenever a sequence is
+   * free or the cache is sized
+   * \param number_of_sequences The maximum number of concurrent sequences
+   * \param sequence_capacity The maximum context size of a sequence in
+   * tokens, longer prompts are reported through on_error
+   * \throw std::runtime_error if the context cannot be created or decoding
+   * fails
+   */
+  void generate_batched(const SequenceRequestSource &next_request,
+                        const std::size_t number_of_sequences,
+                        const std::size_t sequence_capacity);
 };
 } // namespace model_wrapper
@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: output_sink.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief When the output is flushed to its destination
+ */
+enum class FlushPolicy {
+  /**
+   * \brief After every generated token, for interactive use
+   */
+  Token,
+
+  /**
+   * \brief After every token that completes a line
+   */
+  Line,
+
+  /**
+   * \brief After every N tokens
+   */
+  Tokens,
+
+  /**
+   * \brief At the latest M milliseconds after the last flush while output
+   * is pending, also when no token arrives meanwhile
+   */
+  Interval,
+
+  /**
+   * \brief Only when the sink is closed
+   */
+  End
+};
+
+/**
+ * \brief Flush policy with its parameters
+ */
+struct FlushSettings {
+  /**
+   * \brief The flush policy
+   */
+  FlushPolicy policy{FlushPolicy::Token};
+
+  /**
+   * \brief Tokens between two flushes for FlushPolicy::Tokens
+   */
+  std::size_t number_of_tokens{32U};
+
+  /**
+   * \brief Time between two flushes for FlushPolicy::Interval
+   */
+  std::chrono::milliseconds interval{100};
+};
+
+/**
+ * \brief Parse a flush policy
+ * \param text One of "token", "line", "tokens:N", "ms:M" or "end"
+ * \return The flush settings
+ * \throw std::invalid_argument if the text is not a valid policy
+ */
+FlushSettings parse_flush_settings(const std::string_view text);
+
+/**
+ * \brief Buffered output that is written by a background thread
+ * \details The sink is a stream buffer, so it is used through a std::ostream
+ * like any other output. Text is collected in a local buffer and handed to
+ * a writer thread through a lock-free single producer ring buffer, so the
+ * producer never waits for the destination unless the ring is full. Every
+ * flush of the stream marks the end of a token, the flush policy decides if
+ * the destination is flushed then. With FlushPolicy::Interval every token
+ * is handed to the writer, which flushes by its own clock so a slow prefill
+ * or decode step does not hold back written text. Only one thread may write
+ * to the sink.
+ */
+class OutputSink : public std::streambuf {
+private:
+  std::ostream &m_destination;
+  const FlushSettings m_settings;
+  std::vector<char> m_buffer;
+  std::vector<char> m_ring;
+  const std::uint64_t m_ring_mask;
+
+  // Written by the producer
+  std::uint64_t m_write_position{0U};
+  std::size_t m_unflushed_tokens{0U};
+  bool m_has_unflushed_line{false};
+  bool m_is_closed{false};
+
+  // Shared with the writer thread
+  std::atomic<std::uint64_t> m_head{0U};
+  std::atomic<std::uint64_t> m_tail{0U};
+  std::atomic<std::uint64_t> m_flush_position{0U};
+  std::atomic<std::uint32_t> m_events{0U};
+  std::atomic<bool> m_is_closing{false};
+  std::atomic<bool> m_is_failed{false};
+
+  // The writer of FlushPolicy::Interval waits with a timeout, which atomic
+  // waits do not have
+  std::mutex m_wakeup_mutex;
+  std::condition_variable m_wakeup;
+
+  std::jthread m_writer;
+
+  /**
+   * \brief Check if the policy wants a flush after the current token
+   * \return true if the destination should be flushed
+   */
+  bool is_flush_due();
+
+  /**
+   * \brief Move the local buffer into the ring buffer
+   * \param is_flush_needed Ask the writer to flush after the moved text
+   */
+  void publish(const bool is_flush_needed);
+
+  /**
+   * \brief Copy text into the ring buffer, waits while the ring is full
+   * \param data The text
+   * \param size The size of the text
+   */
+  void write_to_ring(const char *data, std::size_t size);
+
+  /**
+   * \brief Count an event and wake up the writer thread
+   */
+  void notify_writer();
+
+  /**
+   * \brief Wait until the producer counts another event
+   * \param events The event count seen last
+   * \param deadline Stop waiting then, for FlushPolicy::Interval only
+   */
+  void wait_for_events(
+      const std::uint32_t events,
+      const std::optional<std::chrono::steady_clock::time_point> &deadline);
+
+  /**
+   * \brief Writer thread, drains the ring buffer into the destination
+   */
+  void run_writer();
+
+protected:
+  /**
+   * \brief Called when the local buffer is full
+   * \param character The character that did not fit
+   * \return The character, or EOF if the sink is closed
+   */
+  int_type overflow(int_type character) override;
+
+  /**
+   * \brief Called on every flush of the stream, i.e. after every token
+   * \return 0
+   */
+  int sync() override;
+
+public:
+  /**
+   * \brief Construct a new OutputSink object and start the writer thread
+   * \param destination The stream to write to, must outlive the sink
+   * \param settings The flush policy
+   * \param ring_size The size of the ring buffer, rounded up to a power of
+   * two
+   */
+  OutputSink(std::ostream &destination, const FlushSettings &settings,
+             const std::size_t ring_size = 1U << 20U);
+
+  /**
+   * \brief Close the sink, errors of the destination are ignored
+   */
+  ~OutputSink() override;
+
+  OutputSink(const OutputSink &) = delete;
+  OutputSink &operator=(const OutputSink &) = delete;
+
+  /**
+   * \brief Write the remaining text, flush the destination and stop the
+   * writer thread
+   * \throw std::runtime_error if writing to the destination failed
+   */
+  void close();
+};
+
+/**
+ * \brief Stream buffer that forwards everything to another one and keeps a
+ * copy of the text
+ * \details Used to store a summary while it is streamed to the output.
+ * Flushes are forwarded as well, so the flush policy of a sink still sees
+ * every token.
+ */
+class CaptureBuffer : public std::streambuf {
+private:
+  std::streambuf *const m_destination;
+  std::string m_text;
+
+protected:
+  /**
+   * \brief Forward a single character
+   * \param character The character
+   * \return The character, or EOF if the destination failed
+   */
+  int_type overflow(int_type character) override;
+
+  /**
+   * \brief Forward a text
+   * \param data The text
+   * \param size The size of the text
+   * \return The number of characters the destination took
+   */
+  std::streamsize xsputn(const char *data, std::streamsize size) override;
+
+  /**
+   * \brief Forward a flush
+   * \return The result of the destination
+   */
+  int sync() override;
+
+public:
+  /**
+   * \brief Construct a new CaptureBuffer object
+   * \param destination The buffer to forward to, must outlive this one
+   */
+  explicit CaptureBuffer(std::streambuf *destination);
+
+  /**
+   * \brief Get the text written so far
+   * \return The captured text
+   */
+  const std::string &get_text() const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: piece_table.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "llama-cpp.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Rendered text piece of every token in the vocabulary
+ * \details All pieces are rendered once into a single arena with an offset
+ * index, so converting a generated token to text is a lookup that does not
+ * allocate. Special tokens are rendered as text, same as
+ * llama_token_to_piece with special rendering.
+ */
+class PieceTable {
+private:
+  std::string m_arena;
+  std::vector<std::uint32_t> m_offsets;
+  double m_build_ms{0.0};
+
+public:
+  /**
+   * \brief Render the pieces of every token
+   * \param vocab The vocabulary of the model
+   * \throw std::runtime_error if a token cannot be rendered
+   */
+  explicit PieceTable(const llama_vocab *vocab);
+
+  /**
+   * \brief Get the text piece of a token
+   * \param token The token
+   * \return View of the piece, valid as long as the table lives
+   * \throw std::runtime_error if the token is not in the vocabulary
+   */
+  std::string_view get_piece(const llama_token token) const;
+
+  /**
+   * \brief Get the number of tokens in the table
+   * \return The vocabulary size
+   */
+  std::size_t size() const;
+
+  /**
+   * \brief Get the memory used by the arena and the index
+   * \return The size in bytes
+   */
+  std::size_t get_memory_bytes() const;
+
+  /**
+   * \brief Get the time it took to build the table
+   * \return The build time in milliseconds
+   */
+  double get_build_ms() const;
+};
+} // namespace model_wrapper
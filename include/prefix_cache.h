@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: prefix_cache.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "llama-cpp.h"
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief On-disk cache of the sequence state after a fixed prompt prefix
+ * \details The prefix (system prompt and chat template up to the user text)
+ * is evaluated once and its sequence state is saved to a file named after
+ * the model fingerprint, the state layout and the prefix hash. Later runs
+ * restore the state
+ * instead of evaluating the prefix again. Restored states are also kept in
+ * memory so repeated calls in the same process do not read the file again.
+ */
+class PrefixCache {
+private:
+  const std::filesystem::path m_directory;
+  std::filesystem::path m_entry_path;
+  std::vector<llama_token> m_prefix_tokens;
+  std::vector<std::uint8_t> m_state;
+  std::mutex m_mutex;
+
+public:
+  /**
+   * \brief File extension of the cache entries
+   */
+  static constexpr std::string_view ENTRY_EXTENSION{".prefix"};
+
+  /**
+   * \brief Construct a new PrefixCache object
+   * \param directory The directory to keep cache entries in, it is created
+   * if it does not exist
+   * \param model_fingerprint The fingerprint of the model file
+   * \param layout_fingerprint The fingerprint of the context settings the
+   * saved state depends on, i.e. the cache types and flash attention
+   * \param prefix_text The prefix text, used for the entry name
+   * \param prefix_tokens The tokens of the prefix
+   * \throw std::filesystem::filesystem_error if the directory cannot be
+   * created
+   */
+  PrefixCache(std::filesystem::path directory,
+              const std::uint64_t model_fingerprint,
+              const std::uint64_t layout_fingerprint,
+              const std::string_view prefix_text,
+              std::vector<llama_token> prefix_tokens);
+
+  /**
+   * \brief Get the tokens of the cached prefix
+   * \return The prefix tokens
+   */
+  const std::vector<llama_token> &get_prefix_tokens() const;
+
+  /**
+   * \brief Restore the prefix state into the first sequence of the context
+   * \details Entries that cannot be loaded or belong to a different prefix
+   * are stale and removed from the disk.
+   * \param context The context to restore the state into
+   * \return true if the state was restored
+   */
+  bool restore(llama_context *context);
+
+  /**
+   * \brief Save the state of the first sequence of the context
+   * \details The context must contain exactly the prefix tokens.
+   * \param context The context to save the state from
+   */
+  void store(llama_context *context);
+
+  /**
+   * \brief Remove all cache entries from a directory
+   * \param directory The cache directory
+   * \return The number of removed entries
+   */
+  static std::size_t clear(const std::filesystem::path &directory);
+};
+} // namespace model_wrapper
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: prompt_builder.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "model.h"
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Builds prompts that wrap a text with fixed system and user prompts
+ * \details The chat template is applied once with a placeholder for the
+ * text, the parts before and after it are kept as text and tokens. A prompt
+ * is then the cached prefix tokens, the tokens of the text and the cached
+ * suffix tokens, so the text is tokenized once straight into the prompt
+ * buffer and no formatted copy of it is made. Chat templates that change
+ * the text itself fall back to formatting the whole prompt.
+ */
+class PromptBuilder {
+private:
+  Model &m_model;
+  const std::string m_system_prompt;
+  const std::string m_user_prompt_end;
+  std::string m_prefix;
+  std::string m_suffix;
+  std::vector<llama_token> m_prefix_tokens;
+  std::vector<llama_token> m_suffix_tokens;
+  bool m_is_split{false};
+
+  /**
+   * \brief Apply the chat template to the text
+   * \param text The text to wrap
+   * \return The formatted prompt
+   * \throw std::runtime_error if the chat template cannot be applied
+   */
+  std::string apply_template(const std::string_view text) const;
+
+public:
+  /**
+   * \brief Construct a new PromptBuilder object
+   * \param model The model to apply the chat template of
+   * \param system_prompt The system prompt
+   * \param user_prompt_end Text appended to the text in the user prompt
+   * \throw std::runtime_error if the chat template cannot be applied or
+   * tokenized
+   */
+  PromptBuilder(Model &model, std::string system_prompt,
+                std::string user_prompt_end);
+
+  /**
+   * \brief Format the prompt as text
+   * \param text The text to wrap
+   * \return The formatted prompt
+   * \throw std::runtime_error if the chat template cannot be applied
+   */
+  std::string format(const std::string_view text) const;
+
+  /**
+   * \brief Build the prompt tokens for a text
+   * \param text The text to wrap
+   * \return The prompt tokens
+   * \throw std::runtime_error if the text cannot be tokenized
+   */
+  std::vector<llama_token> build(const std::string_view text) const;
+
+  /**
+   * \brief Build the prompt tokens for an already tokenized text
+   * \param text_tokens The tokens of the text
+   * \return The prompt tokens
+   * \throw std::runtime_error if the prompt cannot be tokenized
+   */
+  std::vector<llama_token>
+  build(const std::span<const llama_token> text_tokens) const;
+
+  /**
+   * \brief Check if the prompt is split into cached prefix and suffix
+   * \return true if the chat template keeps the text as a single piece
+   */
+  bool is_split() const;
+
+  /**
+   * \brief Get the formatted prompt up to the start of the text
+   * \return The prefix, empty if the prompt is not split
+   */
+  const std::string &get_prefix() const;
+
+  /**
+   * \brief Get the formatted prompt after the end of the text
+   * \return The suffix, empty if the prompt is not split
+   */
+  const std::string &get_suffix() const;
+
+  /**
+   * \brief Get the tokens of the prefix, including BOS if the model adds it
+   * \return The prefix tokens, empty if the prompt is not split
+   */
+  const std::vector<llama_token> &get_prefix_tokens() const;
+
+  /**
+   * \brief Get the tokens of the suffix
+   * \return The suffix tokens, empty if the prompt is not split
+   */
+  const std::vector<llama_token> &get_suffix_tokens() const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: startup.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <thread>
+
+namespace model_wrapper {
+/**
+ * \brief Timings of the steps before the first document token is evaluated
+ */
+struct StartupTimings {
+  /**
+   * \brief Time spent loading the ggml backends in milliseconds
+   */
+  double backend_ms{0.0};
+
+  /**
+   * \brief Time the read ahead requests of the whole model file took in
+   * milliseconds, 0 if they did not finish
+   * \details The kernel reads the file asynchronously, so this is the time
+   * to request the read, not the time until the weights are resident.
+   */
+  double prefetch_submit_ms{0.0};
+
+  /**
+   * \brief Bytes of the model file requested to be read into the page cache
+   */
+  std::size_t prefetched_bytes{0U};
+
+  /**
+   * \brief Time spent on the warmup decode in milliseconds
+   */
+  double warmup_ms{0.0};
+};
+
+/**
+ * \brief Load the ggml backends and route llama.cpp errors to stderr
+ * \details Runs once per process, later calls return right away, so every
+ * model shares the backends loaded for the first one.
+ * \return The time the initialization took in milliseconds, 0 for later
+ * calls
+ */
+double initialize_backend();
+
+/**
+ * \brief Reads a model file into the page cache in the background
+ * \details llama.cpp maps the weights and pages them in on the first decode,
+ * one fault at a time. Started before the model is loaded, the file is read
+ * ahead in large windows while the model is loaded and the prompt is
+ * prepared, so the first decode finds the weights resident. The reading
+ * stops when the object is destroyed.
+ */
+class WeightPrefetcher {
+private:
+  std::atomic<std::size_t> m_prefetched_bytes{0U};
+  std::atomic<double> m_prefetch_submit_ms{0.0};
+  std::jthread m_thread;
+
+  /**
+   * \brief Read the file ahead window by window until it ends or a stop is
+   * requested
+   * \param stop_token The stop token of the thread
+   * \param model_path The model file
+   */
+  void prefetch(const std::stop_token &stop_token,
+                const std::filesystem::path &model_path);
+
+public:
+  /**
+   * \brief Bytes read ahead at once, the stop is checked between windows
+   */
+  static constexpr std::size_t WINDOW_SIZE{16U * 1024U * 1024U};
+
+  /**
+   * \brief Start reading the model file
+   * \details Errors are not reported, llama.cpp reports them when it loads
+   * the file.
+   * \param model_path The model file
+   */
+  explicit WeightPrefetcher(std::filesystem::path model_path);
+
+  /**
+   * \brief Get the number of bytes requested to be read so far
+   * \return The prefetched bytes
+   */
+  std::size_t get_prefetched_bytes() const;
+
+  /**
+   * \brief Get the time the read ahead requests of the whole file took
+   * \details readahead() returns once the reads are queued, the pages may
+   * still be arriving afterwards.
+   * \return The request time in milliseconds, 0 if it is still running
+   */
+  double get_prefetch_submit_ms() const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: stats_report.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "chunked_summarizer.h"
+#include "startup.h"
+#include <cstddef>
+#include <string>
+
+namespace model_wrapper {
+/**
+ * \brief Timings of a run outside of the generated responses
+ */
+struct RunTimings {
+  /**
+   * \brief Time spent loading the model in milliseconds
+   */
+  double model_load_ms{0.0};
+
+  /**
+   * \brief Wall clock time of the whole run in milliseconds
+   */
+  double total_ms{0.0};
+
+  /**
+   * \brief Time spent building the token piece table in milliseconds
+   */
+  double piece_table_ms{0.0};
+
+  /**
+   * \brief Memory used by the token piece table in bytes
+   */
+  std::size_t piece_table_bytes{0U};
+
+  /**
+   * \brief Timings of the startup steps besides the model load
+   */
+  StartupTimings startup{};
+};
+
+/**
+ * \brief Build the performance record of a run
+ * \details The record has the time of every phase (model load, tokenize,
+ * context, prefill, decode and output), the startup steps under startup,
+ * the token counts, the tokens per
+ * second of prefill and decode, the context size and the KV cache memory,
+ * the acceptance of speculative proposals and the generated tokens per
+ * decode of the model, together with the counters measured by llama.cpp.
+ * Prefill only covers evaluating the prompt, tokenization and getting the
+ * context are reported on their own.
+ * \param stats The stats of the summarized input
+ * \param timings The timings of the run
+ * \return The record as a single line JSON object
+ */
+std::string make_stats_record(const SummaryStats &stats,
+                              const RunTimings &timings);
+
+/**
+ * \brief Build the memory record of a document
+ * \details The record has the estimated bytes of the K and V caches, the
+ * compute buffers and the weights, their total, and the cache types and
+ * flash attention setting they were estimated for.
+ * \param estimate The memory estimate, see ChunkedSummarizer::estimate_memory
+ * \param settings The context settings of the model
+ * \param stats The stats of the tokenized document
+ * \return The record as a single line JSON object
+ */
+std::string make_memory_record(const MemoryEstimate &estimate,
+                               const ContextSettings &settings,
+                               const SummaryStats &stats);
+} // namespace model_wrapper
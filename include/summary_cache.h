@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: summary_cache.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace model_wrapper {
+/**
+ * \brief Content-addressed on-disk cache of finished summaries
+ * \details An entry is named after the hash of the document together with
+ * the hash of everything else that decides the summary: the model file, the
+ * temperature, the sampler chain, the prompts and the chunking. Entries are
+ * written to a temporary file and renamed, so any number of processes can
+ * share the directory and never read a partial entry. Reading an entry
+ * touches its modification time, the least recently used entries are
+ * removed once the directory outgrows its size limit.
+ */
+class SummaryCache {
+private:
+  const std::filesystem::path m_directory;
+  const std::uintmax_t m_max_bytes;
+  const std::uint64_t m_configuration_hash;
+
+  /**
+   * \brief Remove the least recently used entries until the cache fits
+   */
+  void evict() const;
+
+public:
+  /**
+   * \brief File extension of the cache entries
+   */
+  static constexpr std::string_view ENTRY_EXTENSION{".summary"};
+
+  /**
+   * \brief Construct a new SummaryCache object
+   * \param directory The directory to keep cache entries in, it is created
+   * if it does not exist
+   * \param max_bytes The size limit of all entries together
+   * \param configuration Everything besides the document that decides the
+   * summary, as text
+   * \throw std::filesystem::filesystem_error if the directory cannot be
+   * created
+   */
+  SummaryCache(std::filesystem::path directory, const std::uintmax_t max_bytes,
+               const std::string_view configuration);
+
+  /**
+   * \brief Get the key of a document
+   * \param document The document
+   * \return 128 bit key as 32 hexadecimal digits
+   */
+  std::string make_key(const std::string_view document) const;
+
+  /**
+   * \brief Look up the summary of a key
+   * \param key The key of the document
+   * \return The summary, std::nullopt on a miss
+   */
+  std::optional<std::string> lookup(const std::string &key) const;
+
+  /**
+   * \brief Store the summary of a key and evict old entries if needed
+   * \details The summary is stored with exactly one trailing newline, the
+   * way a single document is written, so the entry is the same whichever
+   * mode produced it. Failing to write is not an error, the summary is just
+   * not cached.
+   * \param key The key of the document
+   * \param summary The summary
+   */
+  void store(const std::string &key, std::string_view summary) const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: summary_server.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "chunked_summarizer.h"
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace model_wrapper {
+/**
+ * \brief Serves summarize requests over a Unix domain socket
+ * \details Keeps the model loaded between requests. The protocol is
+ * length-prefixed in both directions:
+ * - Request: the document size as 8 byte big-endian integer, followed by the
+ *   document bytes.
+ * - Response: a sequence of frames, each a type byte, the payload size as 4
+ *   byte big-endian integer and the payload. 'T' frames carry summary text as
+ *   it is generated, the response ends with an empty 'D' frame on success or
+ *   an 'E' frame with the error message.
+ *
+ * Every connection carries one request and is served on its own thread.
+ */
+class SummaryServer {
+private:
+  ChunkedSummarizer &m_summarizer;
+  const std::string m_socket_path;
+  const std::size_t m_max_clients;
+
+  /**
+   * \brief Serve a single connection and close it
+   * \param client_fd The connected socket
+   */
+  void serve_client(const int client_fd);
+
+public:
+  /**
+   * \brief Maximum accepted document size in bytes
+   */
+  static constexpr std::uint64_t MAX_DOCUMENT_SIZE{1ULL << 30U};
+
+  /**
+   * \brief Construct a new SummaryServer object
+   * \param summarizer The summarizer with the loaded model
+   * \param socket_path The path of the Unix domain socket
+   * \param max_clients The maximum number of clients served at the same time
+   */
+  SummaryServer(ChunkedSummarizer &summarizer, std::string socket_path,
+                const std::size_t max_clients);
+
+  /**
+   * \brief Listen on the socket and serve clients until the process ends
+   * \details A stale socket file left by a previous server is replaced.
+   * \throw std::runtime_error if the socket cannot be created
+   */
+  void run();
+};
+
+/**
+ * \brief Client for SummaryServer
+ */
+class SummaryClient {
+private:
+  const std::string m_socket_path;
+
+public:
+  /**
+   * \brief Construct a new SummaryClient object
+   * \param socket_path The path of the Unix domain socket
+   */
+  explicit SummaryClient(std::string socket_path);
+
+  /**
+   * \brief Send the document and stream the summary as it arrives
+   * \param in The stream to read the document from until its end
+   * \param out The output stream to write the summary to
+   * \throw std::runtime_error if the server cannot be reached or reports an
+   * error
+   */
+  void summarize(std::istream &in, std::ostream &out) const;
+};
+} // namespace model_wrapper
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: thread_tuner.h
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "model.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace model_wrapper {
+/**
+ * \brief Thread counts for generating tokens and evaluating prompts
+ */
+struct ThreadConfig {
+  /**
+   * \brief Number of threads for generating tokens
+   */
+  std::uint32_t n_threads{0U};
+
+  /**
+   * \brief Number of threads for evaluating prompts
+   */
+  std::uint32_t n_threads_batch{0U};
+};
+
+/**
+ * \brief Finds the best thread counts for a model on this host
+ * \details Prompt evaluation is compute bound and scales with the cores,
+ * generating tokens is bound by the memory bandwidth and gets slower once
+ * the threads contend for it, so both are tuned on their own. The results
+ * are kept in a small file with one line per model and host, later runs
+ * look them up instead of measuring again.
+ */
+class ThreadTuner {
+private:
+  const std::filesystem::path m_cache_path;
+  const std::string m_key;
+
+public:
+  /**
+   * \brief Number of prompt tokens evaluated per measurement
+   */
+  static constexpr std::size_t PROMPT_TOKENS{256U};
+
+  /**
+   * \brief Number of single token decodes per measurement
+   */
+  static constexpr std::size_t DECODED_TOKENS{32U};
+
+  /**
+   * \brief Construct a new ThreadTuner object
+   * \param cache_path The file with the tuned configurations
+   * \param model_path The model file, its fingerprint is part of the key
+   * together with the host name and the available CPUs
+   * \throw std::runtime_error if the model file cannot be read
+   */
+  ThreadTuner(std::filesystem::path cache_path, const std::string &model_path);
+
+  /**
+   * \brief Get the default cache file in the user cache directory
+   * \return The threads.conf file in the default cache directory
+   */
+  static std::filesystem::path get_default_cache_path();
+
+  /**
+   * \brief Get the thread counts to measure
+   * \param number_of_cpus The number of available CPUs
+   * \return Powers of two up to the number of CPUs and the number itself
+   */
+  static std::vector<std::uint32_t>
+  get_candidates(const std::size_t number_of_cpus);
+
+  /**
+   * \brief Look up the configuration of this model and host
+   * \return The configuration, std::nullopt if it was never tuned
+   */
+  std::optional<ThreadConfig> load() const;
+
+  /**
+   * \brief Measure every candidate and store the fastest configuration
+   * \param model The model to measure
+   * \param log The stream to report each measurement to
+   * \return The fastest configuration
+   * \throw std::runtime_error if a measurement fails or the configuration
+   * cannot be stored
+   */
+  ThreadConfig tune(Model &model, std::ostream &log) const;
+
+  /**
+   * \brief Store the configuration of this model and host
+   * \details The file is replaced atomically, so concurrent runs never read
+   * a partial file.
+   * \param config The configuration to store
+   * \throw std::runtime_error if the file cannot be written
+   */
+  void store(const ThreadConfig &config) const;
+};
+} // namespace model_wrapper
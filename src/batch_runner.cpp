@@ -0,0 +1,319 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: batch_runner.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "batch_runner.h"
+#include "json_writer.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace model_wrapper {
+
+namespace {
+using clock = std::chrono::steady_clock;
+
+double elapsed_ms(const clock::time_point start_time) {
+  return std::chrono::duration<double, std::milli>(clock::now() - start_time)
+      .count();
+}
+
+void write_record(std::ostream &out, const std::filesystem::path &input,
+                  std::string_view summary, const std::uint64_t input_bytes,
+                  const SummaryStats &stats, const bool is_cached,
+                  const clock::time_point start_time) {
+  while (!summary.empty() && summary.back() == '\n') {
+    summary.remove_suffix(1U);
+  }
+
+  JsonWriter record;
+  record.add("path", input.string())
+      .add("summary", summary)
+      .add("cached", is_cached)
+      .add("input_bytes", input_bytes)
+      .add("document_tokens", static_cast<std::uint64_t>(stats.document_tokens))
+      .add("chunks", static_cast<std::uint64_t>(stats.number_of_chunks))
+      .add("dropped_tokens", static_cast<std::uint64_t>(stats.dropped_tokens))
+      .add("collapsed_lines",
+           static_cast<std::uint64_t>(stats.collapsed_lines))
+      .add("prompt_tokens",
+           static_cast<std::uint64_t>(stats.generation.prompt_tokens))
+      .add("generated_tokens",
+           static_cast<std::uint64_t>(stats.generation.generated_tokens))
+      .add("prefill_ms", stats.generation.prefill_ms)
+      .add("decode_ms", stats.generation.decode_ms)
+      .add("elapsed_ms", elapsed_ms(start_time));
+  out << record.str() << '\n';
+  out.flush();
+}
+
+void write_error(std::ostream &out, const std::filesystem::path &input,
+                 const std::string_view message,
+                 const clock::time_point start_time) {
+  JsonWriter record;
+  record.add("path", input.string())
+      .add("error", message)
+      .add("elapsed_ms", elapsed_ms(start_time));
+  out << record.str() << '\n';
+  out.flush();
+}
+
+void add_stats(SummaryStats *total_stats, const SummaryStats &stats) {
+  if (total_stats != nullptr) {
+    total_stats->document_bytes += stats.document_bytes;
+    total_stats->document_tokens += stats.document_tokens;
+    total_stats->number_of_chunks += stats.number_of_chunks;
+    total_stats->dropped_bytes += stats.dropped_bytes;
+    total_stats->dropped_tokens += stats.dropped_tokens;
+    total_stats->collapsed_lines += stats.collapsed_lines;
+    total_stats->generation += stats.generation;
+  }
+}
+
+/**
+ * \brief Write the cached summary of the document if there is one
+ * \return true if the summary was cached
+ */
+bool write_cached(const SummaryCache *summary_cache, const std::string &key,
+                  const std::filesystem::path &input,
+                  const std::uint64_t input_bytes, std::ostream &out,
+                  SummaryStats *total_stats,
+                  const clock::time_point start_time) {
+  if (summary_cache == nullptr) {
+    return false;
+  }
+
+  const auto summary = summary_cache->lookup(key);
+  if (!summary) {
+    return false;
+  }
+
+  const SummaryStats stats{input_bytes, 0U, 0U, 0U, 0U, 0U, {}};
+  write_record(out, input, *summary, input_bytes, stats, true, start_time);
+  add_stats(total_stats, stats);
+  return true;
+}
+
+bool summarize_file(const std::filesystem::path &input,
+                    ChunkedSummarizer &summarizer,
+                    const SummaryCache *summary_cache, std::ostream &out,
+                    SummaryStats *total_stats) {
+  const auto start_time = clock::now();
+
+  try {
+    const MappedFile file{input};
+    const auto document = file.get_view();
+    const auto key = summary_cache != nullptr
+                         ? summary_cache->make_key(document)
+                         : std::string{};
+    if (write_cached(summary_cache, key, input, document.size(), out,
+                     total_stats, start_time)) {
+      return true;
+    }
+
+    std::ostringstream summary;
+    const auto stats = summarizer.summarize(document, summary);
+    write_record(out, input, summary.str(), document.size(), stats, false,
+                 start_time);
+    add_stats(total_stats, stats);
+    if (summary_cache != nullptr) {
+      summary_cache->store(key, summary.str());
+    }
+  } catch (const std::exception &e) {
+    write_error(out, input, e.what(), start_time);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief A document too large for a single sequence, it is summarized chunk
+ * by chunk once the batched decoding is done
+ */
+struct DeferredDocument {
+  std::filesystem::path input;
+  std::string key;
+  std::vector<llama_token> tokens;
+  SummaryStats stats;
+  clock::time_point start_time;
+};
+
+bool summarize_deferred(DeferredDocument &document,
+                        ChunkedSummarizer &summarizer,
+                        const SummaryCache *summary_cache, std::ostream &out,
+                        SummaryStats *total_stats) {
+  try {
+    std::ostringstream summary;
+    const auto stats = summarizer.summarize_tokens(
+        std::move(document.tokens), std::move(document.stats), summary);
+    write_record(out, document.input, summary.str(), stats.document_bytes,
+                 stats, false, document.start_time);
+    add_stats(total_stats, stats);
+    if (summary_cache != nullptr) {
+      summary_cache->store(document.key, summary.str());
+    }
+  } catch (const std::exception &e) {
+    write_error(out, document.input, e.what(), document.start_time);
+    return false;
+  }
+
+  return true;
+}
+} // namespace
+
+void BatchRunner::add_path(const std::filesystem::path &path) {
+  if (std::filesystem::is_directory(path)) {
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry :
+         std::filesystem::recursive_directory_iterator{path}) {
+      if (entry.is_regular_file()) {
+        files.push_back(entry.path());
+      }
+    }
+
+    // Directory order is unspecified, keep the output stable between runs
+    std::sort(files.begin(), files.end());
+    m_inputs.insert(m_inputs.end(), files.begin(), files.end());
+  } else if (std::filesystem::exists(path)) {
+    m_inputs.push_back(path);
+  } else {
+    throw std::runtime_error{"Input does not exist: " + path.string()};
+  }
+}
+
+void BatchRunner::add_manifest(const std::filesystem::path &manifest_path) {
+  std::ifstream manifest{manifest_path};
+  if (!manifest) {
+    throw std::runtime_error{"Cannot open manifest: " +
+                             manifest_path.string()};
+  }
+
+  const auto base_directory = manifest_path.parent_path();
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line.starts_with('#')) {
+      continue;
+    }
+
+    const std::filesystem::path path{line};
+    add_path(path.is_relative() ? base_directory / path : path);
+  }
+}
+
+const std::vector<std::filesystem::path> &BatchRunner::get_inputs() const {
+  return m_inputs;
+}
+
+void BatchRunner::set_summary_cache(const SummaryCache *summary_cache) {
+  m_summary_cache = summary_cache;
+}
+
+std::size_t BatchRunner::run(Model &model, ChunkedSummarizer &summarizer,
+                             std::ostream &out,
+                             const std::size_t number_of_sequences,
+                             SummaryStats *total_stats) const {
+  std::size_t number_of_failed{0U};
+
+  if (number_of_sequences <= 1U) {
+    for (const auto &input : m_inputs) {
+      if (!summarize_file(input, summarizer, m_summary_cache, out,
+                          total_stats)) {
+        ++number_of_failed;
+      }
+    }
+    return number_of_failed;
+  }
+
+  std::size_t next_input{0U};
+  std::vector<DeferredDocument> deferred_documents;
+  const auto next_request = [&]() -> std::optional<SequenceRequest> {
+    while (next_input < m_inputs.size()) {
+      const auto &input = m_inputs[next_input++];
+      const auto start_time = clock::now();
+
+      try {
+        const MappedFile file{input};
+        const auto document = file.get_view();
+        auto key = m_summary_cache != nullptr
+                       ? m_summary_cache->make_key(document)
+                       : std::string{};
+        if (write_cached(m_summary_cache, key, input, document.size(), out,
+                         total_stats, start_time)) {
+          continue;
+        }
+
+        SummaryStats document_stats{};
+        auto tokens = summarizer.tokenize_document(document, document_stats);
+
+        // Too large for a single sequence, its chunks would stall the batch
+        // and need their own contexts, so it waits until the batch is done
+        if (tokens.size() > summarizer.get_chunk_tokens()) {
+          deferred_documents.push_back({input, std::move(key),
+                                        std::move(tokens), document_stats,
+                                        start_time});
+          continue;
+        }
+
+        auto summary = std::make_shared<std::string>();
+        return SequenceRequest{
+            std::string{}, summarizer.get_prompt_builder().build(tokens),
+            [summary](const std::string_view piece) {
+              summary->append(piece);
+            },
+            [summary, input, document_stats, start_time, &out, total_stats,
+             summary_cache = m_summary_cache,
+             key = std::move(key)](const GenerationStats &stats) {
+              auto summary_stats = document_stats;
+              summary_stats.generation = stats;
+              write_record(out, input, *summary, summary_stats.document_bytes,
+                           summary_stats, false, start_time);
+              add_stats(total_stats, summary_stats);
+              if (summary_cache != nullptr) {
+                summary_cache->store(key, *summary);
+              }
+            },
+            [input, start_time, &out,
+             &number_of_failed](const std::string &message) {
+              write_error(out, input, message, start_time);
+              ++number_of_failed;
+            }};
+      } catch (const std::exception &e) {
+        write_error(out, input, e.what(), start_time);
+        ++number_of_failed;
+      }
+    }
+
+    return std::nullopt;
+  };
+
+  model.generate_batched(next_request, number_of_sequences,
+                         summarizer.get_sequence_capacity());
+
+  for (auto &document : deferred_documents) {
+    if (!summarize_deferred(document, summarizer, m_summary_cache, out,
+                            total_stats)) {
+      ++number_of_failed;
+    }
+  }
+
+  return number_of_failed;
+}
+} // namespace model_wrapper
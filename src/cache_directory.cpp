@@ -0,0 +1,29 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: cache_directory.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cache_directory.h"
+#include <cstdlib>
+
+namespace model_wrapper {
+
+std::filesystem::path get_default_cache_directory() {
+  std::filesystem::path directory;
+  if (const auto *cache_home = std::getenv("XDG_CACHE_HOME");
+      cache_home != nullptr && cache_home[0] != '\0') {
+    directory = cache_home;
+  } else if (const auto *home = std::getenv("HOME"); home != nullptr) {
+    directory = std::filesystem::path{home} / ".cache";
+  } else {
+    directory = std::filesystem::temp_directory_path();
+  }
+  return directory / "summarize_with_llama_cpp";
+}
+} // namespace model_wrapper
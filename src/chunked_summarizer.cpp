@@ -0,0 +1,441 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: chunked_summarizer.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "chunked_summarizer.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace model_wrapper {
+
+namespace {
+/**
+ * \brief Input read between two tokenizations in streaming mode
+ */
+constexpr std::size_t STREAM_BLOCK_SIZE{16U * 1024U};
+
+/**
+ * \brief Lines read ahead in follow mode before the reader waits
+ */
+constexpr std::size_t FOLLOW_QUEUE_SIZE{4096U};
+
+/**
+ * \brief Lines passed from the reader thread in follow mode
+ */
+struct LineQueue {
+  std::mutex mutex;
+  std::condition_variable is_changed;
+  std::deque<std::string> lines;
+  bool is_closed{false};
+};
+
+} // namespace
+
+ChunkedSummarizer::ChunkedSummarizer(Model &model, SummaryPrompt prompt,
+                                     ChunkingSettings settings)
+    : m_model(model),
+      m_prompt_builder(model, std::move(prompt.system_prompt),
+                       std::move(prompt.user_prompt_end)),
+      m_settings(std::move(settings)), m_selector(model) {
+  // Without a split template, special tokens of the template are not parsed
+  // here, so the overhead is overestimated rather than underestimated
+  const auto prompt_overhead =
+      m_prompt_builder.is_split()
+          ? m_prompt_builder.get_prefix_tokens().size() +
+                m_prompt_builder.get_suffix_tokens().size()
+          : m_model.tokenize_text(format_prompt(std::string_view{})).size();
+  m_reserved_tokens = prompt_overhead + m_model.get_prediction_length();
+  const auto trained_context_size = m_model.get_trained_context_size();
+
+  if (trained_context_size <= m_reserved_tokens) {
+    throw std::runtime_error{
+        "Context of the model is too small for the summary prompts!"};
+  }
+
+  // Chunks are windows of the document tokens and never tokenized again,
+  // so they fill the whole context next to the prompt and the prediction
+  m_chunk_tokens = trained_context_size - m_reserved_tokens;
+
+  if (m_settings.chunk_tokens > 0U) {
+    m_chunk_tokens = std::min(m_chunk_tokens, m_settings.chunk_tokens);
+  }
+
+  if (m_chunk_tokens <= m_settings.overlap_tokens) {
+    throw std::runtime_error{"Chunk size must be larger than the overlap!"};
+  }
+}
+
+std::string
+ChunkedSummarizer::format_prompt(const std::string_view text) const {
+  return m_prompt_builder.format(text);
+}
+
+void ChunkedSummarizer::enable_deduplication(DedupSettings settings) {
+  m_deduplicator.emplace(std::move(settings));
+}
+
+std::vector<llama_token>
+ChunkedSummarizer::tokenize_document(const std::string_view document,
+                                     SummaryStats &stats) const {
+  stats.document_bytes = document.size();
+
+  // Repeated log lines are collapsed before they cost tokenization and
+  // prefill
+  auto text = document;
+  std::string deduplicated;
+  if (m_deduplicator) {
+    auto result = m_deduplicator->deduplicate(document);
+    stats.collapsed_lines = result.input_lines - result.output_lines;
+    deduplicated = std::move(result.text);
+    text = deduplicated;
+  }
+
+  auto tokens = m_model.tokenize_text(text);
+  stats.document_tokens = tokens.size();
+
+  // Prefill is the cost that grows with the document, so a document over
+  // the budget keeps only its highest ranked sentences
+  if (m_settings.token_budget > 0U && tokens.size() > m_settings.token_budget) {
+    const auto selection =
+        m_selector.select(text, tokens, m_settings.token_budget);
+    auto selected_tokens = m_model.tokenize_text(selection.text);
+    stats.dropped_bytes = text.size() - selection.text.size();
+    stats.dropped_tokens =
+        tokens.size() - std::min(tokens.size(), selected_tokens.size());
+    tokens = std::move(selected_tokens);
+  }
+
+  return tokens;
+}
+
+MemoryEstimate
+ChunkedSummarizer::estimate_memory(const std::size_t number_of_tokens) const {
+  if (number_of_tokens <= m_chunk_tokens) {
+    return m_model.estimate_memory(number_of_tokens + m_reserved_tokens);
+  }
+
+  // Same count as split_into_chunks
+  const auto stride = m_chunk_tokens - m_settings.overlap_tokens;
+  const auto number_of_chunks =
+      1U + (number_of_tokens - m_chunk_tokens + stride - 1U) / stride;
+  const auto number_of_contexts = std::clamp<std::size_t>(
+      m_settings.parallel_jobs, 1U, number_of_chunks);
+
+  auto estimate = m_model.estimate_memory(m_chunk_tokens + m_reserved_tokens);
+  estimate.number_of_contexts = number_of_contexts;
+  estimate.kv_bytes *= number_of_contexts;
+  estimate.compute_bytes *= number_of_contexts;
+  return estimate;
+}
+
+std::vector<std::span<const llama_token>> ChunkedSummarizer::split_into_chunks(
+    const std::vector<llama_token> &tokens) const {
+  const auto stride = m_chunk_tokens - m_settings.overlap_tokens;
+  const std::span<const llama_token> all_tokens{tokens};
+  std::vector<std::span<const llama_token>> chunks;
+
+  for (std::size_t start = 0U; start < tokens.size(); start += stride) {
+    const auto length = std::min(m_chunk_tokens, tokens.size() - start);
+    chunks.push_back(all_tokens.subspan(start, length));
+
+    if (start + length == tokens.size()) {
+      break;
+    }
+  }
+
+  return chunks;
+}
+
+std::vector<std::string> ChunkedSummarizer::summarize_chunks(
+    const std::vector<std::span<const llama_token>> &chunks,
+    SummaryStats &stats) const {
+  std::vector<std::string> summaries(chunks.size());
+  std::vector<GenerationStats> chunk_stats(chunks.size());
+  std::atomic<std::size_t> next_chunk{0U};
+  std::exception_ptr failure{nullptr};
+  std::mutex failure_mutex;
+
+  // Every worker pulls the next chunk until all are done, so a slow chunk
+  // does not hold back the others
+  const auto worker = [&]() {
+    for (auto index = next_chunk++; index < chunks.size();
+         index = next_chunk++) {
+      try {
+        std::ostringstream summary;
+        // The window tokens go into the prompt as they are, without
+        // detokenizing and tokenizing them again
+        chunk_stats[index] = m_model.generate_response(
+            m_prompt_builder.build(chunks[index]), summary);
+        summaries[index] = summary.str();
+      } catch (...) {
+        const std::lock_guard lock{failure_mutex};
+        if (!failure) {
+          failure = std::current_exception();
+        }
+        next_chunk = chunks.size();
+      }
+    }
+  };
+
+  const auto number_of_workers =
+      std::clamp<std::size_t>(m_settings.parallel_jobs, 1U, chunks.size());
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t i = 1U; i < number_of_workers; ++i) {
+      workers.emplace_back(worker);
+    }
+    worker();
+  }
+
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+
+  stats.number_of_chunks += chunks.size();
+  for (const auto &generation : chunk_stats) {
+    stats.generation += generation;
+  }
+
+  return summaries;
+}
+
+SummaryStats ChunkedSummarizer::summarize(const std::string_view document,
+                                          std::ostream &out) {
+  return summarize(document, out, {});
+}
+
+SummaryStats
+ChunkedSummarizer::summarize(const std::string_view document,
+                             std::ostream &out,
+                             const std::filesystem::path &session_path) {
+  SummaryStats stats{};
+  auto tokens = tokenize_document(document, stats);
+
+  // Only a document that fits into a single prompt shares its state with
+  // the previous run
+  if (!session_path.empty() && tokens.size() <= m_chunk_tokens) {
+    stats.generation += m_model.generate_response(
+        m_prompt_builder.build(tokens), session_path, out);
+    return stats;
+  }
+
+  return summarize_tokens(std::move(tokens), std::move(stats), out);
+}
+
+SummaryStats ChunkedSummarizer::summarize_tokens(
+    std::vector<llama_token> tokens, SummaryStats stats, std::ostream &out) {
+  while (tokens.size() > m_chunk_tokens) {
+    const auto summaries = summarize_chunks(split_into_chunks(tokens), stats);
+
+    std::string combined_summaries;
+    for (const auto &summary : summaries) {
+      combined_summaries.append(summary).append("\n");
+    }
+
+    auto combined_tokens = m_model.tokenize_text(combined_summaries);
+    if (combined_tokens.size() >= tokens.size()) {
+      throw std::runtime_error{
+          "Cannot summarize document: Chunk summaries are not shorter!"};
+    }
+
+    tokens = std::move(combined_tokens);
+  }
+
+  // The text is tokenized already, only the template parts are added
+  stats.generation +=
+      m_model.generate_response(m_prompt_builder.build(tokens), out);
+
+  return stats;
+}
+
+SummaryStats ChunkedSummarizer::summarize_stream(std::istream &in,
+                                                 std::ostream &out) {
+  std::string text;
+
+  // The selection and the deduplication need the whole document
+  if (!m_prompt_builder.is_split() || m_settings.token_budget > 0U ||
+      m_deduplicator) {
+    text.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+    return summarize(text, out);
+  }
+
+  SummaryStats stats{};
+  // Kept apart from the prompt, so a document that outgrows it is split
+  // into chunks without tokenizing it again
+  std::vector<llama_token> document_tokens;
+  std::size_t tokenized_size{0U};
+  const auto next_tokens = [&](std::vector<llama_token> &tokens) {
+    if (tokens.empty()) {
+      tokens = m_prompt_builder.get_prefix_tokens();
+    }
+
+    // Every call reads at least one line so a long line cannot stall it
+    const auto read_start_size = text.size();
+    std::string line;
+    while (text.size() - read_start_size < STREAM_BLOCK_SIZE &&
+           std::getline(in, line)) {
+      text.append(line);
+      if (!in.eof()) {
+        text.push_back('\n');
+      }
+    }
+
+    const bool is_complete = !in;
+    const auto pending = std::string_view{text}.substr(tokenized_size);
+    const auto length =
+        is_complete ? pending.size() : Model::find_token_boundary(pending);
+    if (length > 0U) {
+      const auto number_of_tokens = document_tokens.size();
+      m_model.tokenize_text_into(pending.substr(0U, length), document_tokens);
+      tokens.insert(tokens.end(), document_tokens.begin() + number_of_tokens,
+                    document_tokens.end());
+      tokenized_size += length;
+    }
+
+    if (is_complete) {
+      const auto &suffix_tokens = m_prompt_builder.get_suffix_tokens();
+      tokens.insert(tokens.end(), suffix_tokens.begin(), suffix_tokens.end());
+    }
+    return !is_complete;
+  };
+
+  if (const auto generation =
+          m_model.generate_streamed(next_tokens, get_sequence_capacity(), out);
+      generation) {
+    stats.document_bytes = text.size();
+    stats.document_tokens = document_tokens.size();
+    stats.generation = *generation;
+    return stats;
+  }
+
+  // Too large for a single prompt, the rest is read before map-reduce and
+  // only the text after the tokenized blocks is tokenized
+  text.append(std::istreambuf_iterator<char>(in),
+              std::istreambuf_iterator<char>());
+  const auto rest_tokens =
+      m_model.tokenize_text(std::string_view{text}.substr(tokenized_size));
+  document_tokens.insert(document_tokens.end(), rest_tokens.begin(),
+                         rest_tokens.end());
+  stats.document_bytes = text.size();
+  stats.document_tokens = document_tokens.size();
+  return summarize_tokens(std::move(document_tokens), std::move(stats), out);
+}
+
+void ChunkedSummarizer::follow(
+    std::istream &in, std::ostream &out, const FollowSettings &settings,
+    const std::function<void(const GenerationStats &stats)> &on_summary) {
+  if (!m_prompt_builder.is_split()) {
+    throw std::runtime_error{
+        "Cannot follow: Chat template does not keep the document!"};
+  }
+
+  // A blocked read cannot be interrupted, so the reader is detached and
+  // shares the queue; it ends with the input
+  const auto queue = std::make_shared<LineQueue>();
+  std::thread{[queue, &in]() {
+    std::string line;
+    while (std::getline(in, line)) {
+      std::unique_lock lock{queue->mutex};
+      queue->is_changed.wait(lock, [&]() {
+        return queue->lines.size() < FOLLOW_QUEUE_SIZE;
+      });
+      queue->lines.push_back(std::move(line));
+      queue->is_changed.notify_all();
+    }
+    const std::lock_guard lock{queue->mutex};
+    queue->is_closed = true;
+    queue->is_changed.notify_all();
+  }}.detach();
+
+  using clock_type = std::chrono::steady_clock;
+  const auto summary_lines = std::max<std::size_t>(settings.summary_lines, 1U);
+  std::size_t number_of_pending{0U};
+  std::size_t number_of_lines{0U};
+  clock_type::time_point first_pending_time{};
+  std::string text;
+
+  const auto next_tokens = [&](std::vector<llama_token> &tokens) {
+    std::unique_lock lock{queue->mutex};
+    const auto has_lines = [&]() {
+      return !queue->lines.empty() || queue->is_closed;
+    };
+    if (number_of_pending == 0U) {
+      queue->is_changed.wait(lock, has_lines);
+    } else {
+      queue->is_changed.wait_until(
+          lock, first_pending_time + settings.summary_interval, has_lines);
+    }
+
+    text.clear();
+    const auto number_of_new = queue->lines.size();
+    for (auto &line : queue->lines) {
+      text.append(line).push_back('\n');
+    }
+    queue->lines.clear();
+    const bool is_closed = queue->is_closed;
+    queue->is_changed.notify_all();
+    lock.unlock();
+
+    if (number_of_new > 0U) {
+      if (number_of_pending == 0U) {
+        first_pending_time = clock_type::now();
+      }
+      number_of_pending += number_of_new;
+      number_of_lines += number_of_new;
+      m_model.tokenize_text_into(text, tokens);
+    }
+
+    RollingUpdate update{};
+    update.is_finished = is_closed;
+    update.is_summary_due =
+        number_of_pending > 0U &&
+        (number_of_pending >= summary_lines || is_closed ||
+         clock_type::now() >= first_pending_time + settings.summary_interval);
+    if (update.is_summary_due) {
+      out << "\n--- Summary after " << number_of_lines << " lines ---\n";
+      number_of_pending = 0U;
+    }
+    return update;
+  };
+
+  m_model.generate_rolling(m_prompt_builder.get_prefix_tokens(),
+                           m_prompt_builder.get_suffix_tokens(), next_tokens,
+                           get_sequence_capacity(), out, on_summary);
+}
+
+std::string ChunkedSummarizer::get_prompt_prefix() const {
+  return m_prompt_builder.get_prefix();
+}
+
+const PromptBuilder &ChunkedSummarizer::get_prompt_builder() const {
+  return m_prompt_builder;
+}
+
+std::size_t ChunkedSummarizer::get_chunk_tokens() const {
+  return m_chunk_tokens;
+}
+
+std::size_t ChunkedSummarizer::get_sequence_capacity() const {
+  return m_chunk_tokens + m_reserved_tokens;
+}
+} // namespace model_wrapper
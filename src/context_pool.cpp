@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: context_pool.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "context_pool.h"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace model_wrapper {
+
+ContextPool::Lease::Lease(ContextPool *pool, const std::size_t capacity,
+                          llama_context_ptr context, llama_sampler_ptr sampler)
+    : m_pool(pool), m_capacity(capacity), m_context(std::move(context)),
+      m_sampler(std::move(sampler)) {}
+
+ContextPool::Lease::~Lease() {
+  if (m_pool && m_context) {
+    m_pool->release(m_capacity, std::move(m_context), std::move(m_sampler));
+  }
+}
+
+llama_context *ContextPool::Lease::get_context() const {
+  return m_context.get();
+}
+
+llama_sampler *ContextPool::Lease::get_sampler() const {
+  return m_sampler.get();
+}
+
+ContextPool::ContextPool(ContextFactory create_context,
+                         const llama_sampler *sampler_template,
+                         const std::size_t max_idle_per_bucket,
+                         const std::size_t max_idle_tokens,
+                         const std::size_t max_capacity)
+    : m_create_context(std::move(create_context)),
+      m_sampler_template(sampler_template),
+      m_max_idle_per_bucket(max_idle_per_bucket),
+      m_max_idle_tokens(max_idle_tokens),
+      m_max_capacity(max_capacity) {}
+
+std::size_t
+ContextPool::get_capacity(const std::size_t number_of_tokens) const {
+  // Rounding up lets prompts of similar length share contexts, but a bucket
+  // beyond the trained context would only waste memory
+  const auto capacity = std::bit_ceil(number_of_tokens);
+  if (capacity > m_max_capacity) {
+    return std::max(number_of_tokens, m_max_capacity);
+  }
+  return capacity;
+}
+
+ContextPool::Lease ContextPool::acquire(const std::size_t number_of_tokens) {
+  const auto capacity = get_capacity(number_of_tokens);
+  m_is_used.store(true, std::memory_order_relaxed);
+
+  {
+    const std::lock_guard lock{m_mutex};
+    if (auto bucket = m_idle.find(capacity);
+        bucket != m_idle.end() && !bucket->second.empty()) {
+      auto entry = std::move(bucket->second.back());
+      bucket->second.pop_back();
+      m_idle_tokens -= capacity;
+      return Lease{this, capacity, std::move(entry.context),
+                   std::move(entry.sampler)};
+    }
+  }
+
+  auto context = m_create_context(capacity);
+  if (!context) {
+    throw std::runtime_error{"Failed to initialize context!"};
+  }
+
+  return Lease{this, capacity, std::move(context),
+               llama_sampler_ptr{llama_sampler_clone(m_sampler_template)}};
+}
+
+bool ContextPool::is_used() const {
+  return m_is_used.load(std::memory_order_relaxed);
+}
+
+void ContextPool::release(const std::size_t capacity,
+                          llama_context_ptr context,
+                          llama_sampler_ptr sampler) {
+  llama_memory_clear(llama_get_memory(context.get()), true);
+  llama_perf_context_reset(context.get());
+  llama_sampler_reset(sampler.get());
+
+  // Freeing the evicted contexts takes a while, so it happens after the
+  // lock is released
+  std::vector<Entry> evicted;
+  {
+    const std::lock_guard lock{m_mutex};
+    auto &bucket = m_idle[capacity];
+    if (bucket.size() < m_max_idle_per_bucket) {
+      bucket.push_back(
+          {std::move(context), std::move(sampler), m_number_of_releases++});
+      m_idle_tokens += capacity;
+      evicted = evict_idle();
+    }
+  }
+}
+
+std::vector<ContextPool::Entry> ContextPool::evict_idle() {
+  std::vector<Entry> evicted;
+  while (m_idle_tokens > m_max_idle_tokens) {
+    // Buckets hand out their most recent entry, so the oldest is in front
+    auto oldest = m_idle.end();
+    for (auto bucket = m_idle.begin(); bucket != m_idle.end(); ++bucket) {
+      if (bucket->second.empty()) {
+        continue;
+      }
+      if (oldest == m_idle.end() || bucket->second.front().release_order <
+                                        oldest->second.front().release_order) {
+        oldest = bucket;
+      }
+    }
+
+    evicted.push_back(std::move(oldest->second.front()));
+    oldest->second.erase(oldest->second.begin());
+    m_idle_tokens -= oldest->first;
+  }
+  return evicted;
+}
+
+void ContextPool::clear() {
+  const std::lock_guard lock{m_mutex};
+  m_idle.clear();
+  m_idle_tokens = 0U;
+}
+} // namespace model_wrapper
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: cpu_placement.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cpu_placement.h"
+#include <algorithm>
+#include <charconv>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace model_wrapper {
+
+namespace {
+int parse_cpu(const std::string_view text) {
+  int cpu{-1};
+  const auto result = std::from_chars(text.data(), text.data() + text.size(),
+                                      cpu);
+  if (result.ec != std::errc{} || result.ptr != text.data() + text.size() ||
+      cpu < 0 || cpu >= CPU_SETSIZE) {
+    throw std::invalid_argument{"Invalid CPU: " + std::string{text}};
+  }
+  return cpu;
+}
+} // namespace
+
+std::vector<int> parse_cpu_list(const std::string_view cpu_list) {
+  std::vector<int> cpus;
+  std::size_t start{0U};
+
+  while (start <= cpu_list.size()) {
+    auto end = cpu_list.find(',', start);
+    if (end == std::string_view::npos) {
+      end = cpu_list.size();
+    }
+
+    const auto item = cpu_list.substr(start, end - start);
+    if (const auto dash = item.find('-'); dash != std::string_view::npos) {
+      const auto first = parse_cpu(item.substr(0U, dash));
+      const auto last = parse_cpu(item.substr(dash + 1U));
+      if (first > last) {
+        throw std::invalid_argument{"Invalid CPU range: " + std::string{item}};
+      }
+      for (auto cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } else {
+      cpus.push_back(parse_cpu(item));
+    }
+
+    start = end + 1U;
+  }
+
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+void set_cpu_affinity(const std::vector<int> &cpus) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (const auto cpu : cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    throw std::runtime_error{"Cannot set CPU affinity!"};
+  }
+}
+
+std::size_t get_available_cpus() {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+    return std::max(1, CPU_COUNT(&cpu_set));
+  }
+  return std::max(1U, std::thread::hardware_concurrency());
+}
+
+ggml_numa_strategy parse_numa_strategy(const std::string_view strategy) {
+  if (strategy == "none") {
+    return GGML_NUMA_STRATEGY_DISABLED;
+  }
+  if (strategy == "distribute") {
+    return GGML_NUMA_STRATEGY_DISTRIBUTE;
+  }
+  if (strategy == "isolate") {
+    return GGML_NUMA_STRATEGY_ISOLATE;
+  }
+  if (strategy == "numactl") {
+    return GGML_NUMA_STRATEGY_NUMACTL;
+  }
+  if (strategy == "mirror") {
+    return GGML_NUMA_STRATEGY_MIRROR;
+  }
+  throw std::invalid_argument{"Unknown NUMA strategy: " +
+                              std::string{strategy}};
+}
+} // namespace model_wrapper
@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: draft_source.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "draft_source.h"
+#include "hash.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace model_wrapper {
+
+DraftModelSource::DraftModelSource(ContextPool::Lease lease)
+    : m_lease(std::move(lease)) {}
+
+void DraftModelSource::decode(std::span<llama_token> tokens) {
+  const auto context = m_lease.get_context();
+  const std::size_t batch_size = llama_n_batch(context);
+
+  for (std::size_t position = 0U; position < tokens.size();
+       position += batch_size) {
+    const auto batch = llama_batch_get_one(
+        tokens.data() + position,
+        std::min(batch_size, tokens.size() - position));
+    if (llama_decode(context, batch) != 0) {
+      throw std::runtime_error{"Cannot draft tokens: Failed to decode!"};
+    }
+  }
+}
+
+void DraftModelSource::draft(const std::span<const llama_token> history,
+                             const std::size_t max_tokens,
+                             std::vector<llama_token> &drafted) {
+  const auto context = m_lease.get_context();
+  const auto sampler = m_lease.get_sampler();
+  const std::size_t context_size = llama_n_ctx(context);
+
+  // The draft model may have a smaller context, it stops drafting then
+  if (history.size() + 1U >= context_size) {
+    return;
+  }
+
+  // Drop the rejected proposals of the last call, keep the common part
+  const auto mismatch = std::mismatch(m_evaluated.begin(), m_evaluated.end(),
+                                      history.begin(), history.end());
+  auto number_of_common = static_cast<std::size_t>(
+      std::distance(m_evaluated.begin(), mismatch.first));
+  // The last token is evaluated again to get its logits
+  number_of_common = std::min(number_of_common, history.size() - 1U);
+  llama_memory_seq_rm(llama_get_memory(context), 0, number_of_common, -1);
+  m_evaluated.assign(history.begin(), history.end());
+
+  decode({m_evaluated.data() + number_of_common,
+          m_evaluated.size() - number_of_common});
+
+  for (std::size_t i = 0U;
+       i < max_tokens && m_evaluated.size() < context_size; ++i) {
+    auto token = llama_sampler_sample(sampler, context, -1);
+    drafted.push_back(token);
+    m_evaluated.push_back(token);
+
+    if (i + 1U < max_tokens) {
+      decode({&m_evaluated.back(), 1U});
+    }
+  }
+
+  // The last proposal was not evaluated
+  if (!drafted.empty() && m_evaluated.size() > history.size()) {
+    m_evaluated.pop_back();
+  }
+}
+
+PromptLookupSource::PromptLookupSource(
+    const std::span<const llama_token> prompt,
+    const SpeculativeSettings &settings)
+    : m_prompt_size(prompt.size()), m_max_ngram_size(settings.max_ngram_size),
+      m_min_ngram_size(settings.min_ngram_size) {
+  if (m_min_ngram_size == 0U || m_min_ngram_size > m_max_ngram_size) {
+    throw std::invalid_argument{"Invalid n-gram sizes for prompt lookup!"};
+  }
+
+  // Later occurrences overwrite earlier ones, n-grams at the very end of the
+  // prompt have nothing to propose and are skipped
+  for (auto size = m_min_ngram_size; size <= m_max_ngram_size; ++size) {
+    for (std::size_t end = size; end < prompt.size(); ++end) {
+      m_ngram_ends[hash_ngram(prompt.subspan(end - size, size))] = end;
+    }
+  }
+}
+
+std::uint64_t
+PromptLookupSource::hash_ngram(const std::span<const llama_token> ngram) {
+  return hash_bytes({reinterpret_cast<const char *>(ngram.data()),
+                     ngram.size_bytes()},
+                    ngram.size());
+}
+
+void PromptLookupSource::draft(const std::span<const llama_token> history,
+                               const std::size_t max_tokens,
+                               std::vector<llama_token> &drafted) {
+  if (history.size() < m_prompt_size) {
+    return;
+  }
+
+  const auto prompt = history.first(m_prompt_size);
+  for (auto size = std::min(m_max_ngram_size, history.size());
+       size >= m_min_ngram_size; --size) {
+    const auto ngram = history.last(size);
+    const auto found = m_ngram_ends.find(hash_ngram(ngram));
+    if (found == m_ngram_ends.end()) {
+      continue;
+    }
+
+    // Hashes can collide, the tokens decide
+    const auto end = found->second;
+    if (!std::equal(ngram.begin(), ngram.end(),
+                    prompt.begin() + (end - size))) {
+      continue;
+    }
+
+    const auto length = std::min(max_tokens, m_prompt_size - end);
+    drafted.insert(drafted.end(), prompt.begin() + end,
+                   prompt.begin() + (end + length));
+    return;
+  }
+}
+} // namespace model_wrapper
@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: extractive_selector.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "extractive_selector.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_wrapper {
+
+namespace {
+/**
+ * \brief Number of buckets words are hashed into, collisions only blur the
+ * scores slightly
+ */
+constexpr std::size_t VOCABULARY_SIZE{1U << 18U};
+
+/**
+ * \brief Spans longer than this are cut at the next space, so a document
+ * without sentence ends is not a single span
+ */
+constexpr std::size_t MAX_SPAN_SIZE{1024U};
+
+bool is_space(const char character) {
+  return character == ' ' || character == '\t' || character == '\n' ||
+         character == '\r' || character == '\v' || character == '\f';
+}
+
+bool is_word_character(const char character) {
+  return (character >= 'a' && character <= 'z') ||
+         (character >= 'A' && character <= 'Z') ||
+         (character >= '0' && character <= '9') || character == '_' ||
+         static_cast<unsigned char>(character) >= 0x80U;
+}
+
+/**
+ * \brief Split the text after line breaks and sentence ends
+ * \details The whitespace after a split belongs to the span before it, so
+ * the spans joined again give the text.
+ * \return The end offset of every span
+ */
+std::vector<std::size_t> split_into_spans(const std::string_view text) {
+  std::vector<std::size_t> span_ends;
+  std::size_t span_start{0U};
+  std::size_t position{0U};
+
+  while (position < text.size()) {
+    const auto character = text[position++];
+    const bool is_sentence_end =
+        (character == '.' || character == '!' || character == '?') &&
+        (position == text.size() || is_space(text[position]));
+    const bool is_too_long =
+        position - span_start >= MAX_SPAN_SIZE && is_space(character);
+    if (character != '\n' && !is_sentence_end && !is_too_long) {
+      continue;
+    }
+
+    while (position < text.size() && is_space(text[position])) {
+      ++position;
+    }
+    span_ends.push_back(position);
+    span_start = position;
+  }
+
+  if (span_start < text.size()) {
+    span_ends.push_back(text.size());
+  }
+  return span_ends;
+}
+
+/**
+ * \brief Append the vocabulary bucket of every word in the text
+ */
+void hash_words(const std::string_view text,
+                std::vector<std::uint32_t> &buckets) {
+  constexpr std::uint32_t FNV_OFFSET{2166136261U};
+  constexpr std::uint32_t FNV_PRIME{16777619U};
+
+  std::uint32_t hash{FNV_OFFSET};
+  bool is_in_word{false};
+  for (const auto character : text) {
+    if (is_word_character(character)) {
+      const auto lower = character >= 'A' && character <= 'Z'
+                             ? static_cast<char>(character - 'A' + 'a')
+                             : character;
+      hash = (hash ^ static_cast<unsigned char>(lower)) * FNV_PRIME;
+      is_in_word = true;
+    } else if (is_in_word) {
+      buckets.push_back(hash % VOCABULARY_SIZE);
+      hash = FNV_OFFSET;
+      is_in_word = false;
+    }
+  }
+  if (is_in_word) {
+    buckets.push_back(hash % VOCABULARY_SIZE);
+  }
+}
+
+/**
+ * \brief Count the tokens of every span
+ * \details The pieces of the document tokens give the offset each token
+ * starts at, a token counts for the span its start is in.
+ * \return The number of tokens of every span
+ */
+std::vector<std::size_t>
+count_span_tokens(const std::vector<std::size_t> &span_ends,
+                  const std::vector<llama_token> &tokens,
+                  const PieceTable &piece_table) {
+  std::vector<std::size_t> span_tokens(span_ends.size(), 0U);
+  std::size_t span{0U};
+  std::size_t offset{0U};
+  for (const auto token : tokens) {
+    while (span + 1U < span_ends.size() && offset >= span_ends[span]) {
+      ++span;
+    }
+    ++span_tokens[span];
+    offset += piece_table.get_piece(token).size();
+  }
+  return span_tokens;
+}
+} // namespace
+
+ExtractiveSelector::ExtractiveSelector(const Model &model) : m_model(model) {}
+
+Selection ExtractiveSelector::select(const std::string_view document,
+                                     const std::vector<llama_token> &tokens,
+                                     const std::size_t token_budget) const {
+  Selection selection{};
+  const auto span_ends = split_into_spans(document);
+  const auto number_of_spans = span_ends.size();
+  selection.number_of_spans = number_of_spans;
+  if (number_of_spans == 0U) {
+    return selection;
+  }
+
+  // Every span keeps its distinct buckets followed by their counts
+  std::vector<std::uint32_t> terms;
+  std::vector<std::uint32_t> counts;
+  std::vector<std::size_t> term_starts(number_of_spans + 1U, 0U);
+  std::vector<std::uint32_t> document_frequency(VOCABULARY_SIZE, 0U);
+  std::vector<std::uint32_t> buckets;
+  for (std::size_t span = 0U, start = 0U; span < number_of_spans; ++span) {
+    buckets.clear();
+    hash_words(document.substr(start, span_ends[span] - start), buckets);
+    start = span_ends[span];
+
+    std::sort(buckets.begin(), buckets.end());
+    for (std::size_t i = 0U; i < buckets.size();) {
+      const auto bucket = buckets[i];
+      const auto run_start = i;
+      while (i < buckets.size() && buckets[i] == bucket) {
+        ++i;
+      }
+      terms.push_back(bucket);
+      counts.push_back(static_cast<std::uint32_t>(i - run_start));
+      ++document_frequency[bucket];
+    }
+    term_starts[span + 1U] = terms.size();
+  }
+
+  // Inverse document frequency and the document vector over the vocabulary
+  std::vector<float> weights(VOCABULARY_SIZE);
+  const auto log_spans = std::log(static_cast<float>(number_of_spans) + 1.0f);
+  for (std::size_t bucket = 0U; bucket < VOCABULARY_SIZE; ++bucket) {
+    weights[bucket] =
+        log_spans -
+        std::log(static_cast<float>(document_frequency[bucket]) + 1.0f);
+  }
+  std::vector<float> centroid(VOCABULARY_SIZE, 0.0f);
+  for (std::size_t i = 0U; i < terms.size(); ++i) {
+    centroid[terms[i]] += static_cast<float>(counts[i]) * weights[terms[i]];
+  }
+
+  // Each span is compared with the rest of the document, otherwise its own
+  // rare words would make it look central
+  std::vector<float> scores(number_of_spans, 0.0f);
+  for (std::size_t span = 0U; span < number_of_spans; ++span) {
+    float dot{0.0f};
+    float norm{0.0f};
+    for (auto i = term_starts[span]; i < term_starts[span + 1U]; ++i) {
+      const auto weight = static_cast<float>(counts[i]) * weights[terms[i]];
+      dot += weight * (centroid[terms[i]] - weight);
+      norm += weight * weight;
+    }
+    scores[span] = norm > 0.0f ? dot / std::sqrt(norm) : 0.0f;
+  }
+
+  // Earlier spans win ties, they usually set the context
+  std::vector<std::size_t> ranking(number_of_spans);
+  std::iota(ranking.begin(), ranking.end(), 0U);
+  std::stable_sort(ranking.begin(), ranking.end(),
+                   [&](const auto lhs, const auto rhs) {
+                     return scores[lhs] > scores[rhs];
+                   });
+
+  // The document is tokenized already, so no span is tokenized again
+  const auto span_tokens =
+      count_span_tokens(span_ends, tokens, m_model.get_piece_table());
+  const auto smallest_span =
+      *std::min_element(span_tokens.begin(), span_tokens.end());
+
+  std::vector<bool> is_selected(number_of_spans, false);
+  for (const auto span : ranking) {
+    // No span fits into what is left of the budget
+    if (token_budget - selection.selected_tokens < smallest_span) {
+      break;
+    }
+    if (selection.selected_tokens + span_tokens[span] <= token_budget) {
+      selection.selected_tokens += span_tokens[span];
+      is_selected[span] = true;
+      ++selection.number_of_selected_spans;
+    }
+  }
+
+  for (std::size_t span = 0U; span < number_of_spans; ++span) {
+    if (is_selected[span]) {
+      const auto start = span > 0U ? span_ends[span - 1U] : 0U;
+      selection.text.append(document.substr(start, span_ends[span] - start));
+    }
+  }
+
+  return selection;
+}
+} // namespace model_wrapper
@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: hash.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "hash.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace model_wrapper {
+
+namespace {
+constexpr std::uint64_t PRIME_1{11400714785074694791ULL};
+constexpr std::uint64_t PRIME_2{14029467366897019727ULL};
+constexpr std::uint64_t PRIME_3{1609587929392839161ULL};
+constexpr std::uint64_t PRIME_4{9650029242287828579ULL};
+constexpr std::uint64_t PRIME_5{2870177450012600261ULL};
+
+template <typename T> T read_value(const char *data) {
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+std::uint64_t round(std::uint64_t accumulator, const std::uint64_t input) {
+  accumulator += input * PRIME_2;
+  accumulator = std::rotl(accumulator, 31);
+  return accumulator * PRIME_1;
+}
+
+std::uint64_t merge_round(std::uint64_t accumulator,
+                          const std::uint64_t value) {
+  accumulator ^= round(0U, value);
+  return accumulator * PRIME_1 + PRIME_4;
+}
+} // namespace
+
+std::uint64_t hash_bytes(const std::string_view data,
+                         const std::uint64_t seed) {
+  const char *position = data.data();
+  const char *const end = position + data.size();
+  std::uint64_t hash;
+
+  if (data.size() >= 32U) {
+    std::uint64_t v1 = seed + PRIME_1 + PRIME_2;
+    std::uint64_t v2 = seed + PRIME_2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - PRIME_1;
+
+    for (; position + 32 <= end; position += 32) {
+      v1 = round(v1, read_value<std::uint64_t>(position));
+      v2 = round(v2, read_value<std::uint64_t>(position + 8));
+      v3 = round(v3, read_value<std::uint64_t>(position + 16));
+      v4 = round(v4, read_value<std::uint64_t>(position + 24));
+    }
+
+    hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) +
+           std::rotl(v4, 18);
+    hash = merge_round(hash, v1);
+    hash = merge_round(hash, v2);
+    hash = merge_round(hash, v3);
+    hash = merge_round(hash, v4);
+  } else {
+    hash = seed + PRIME_5;
+  }
+
+  hash += data.size();
+
+  for (; position + 8 <= end; position += 8) {
+    hash ^= round(0U, read_value<std::uint64_t>(position));
+    hash = std::rotl(hash, 27) * PRIME_1 + PRIME_4;
+  }
+
+  if (position + 4 <= end) {
+    hash ^= read_value<std::uint32_t>(position) * PRIME_1;
+    hash = std::rotl(hash, 23) * PRIME_2 + PRIME_3;
+    position += 4;
+  }
+
+  for (; position < end; ++position) {
+    hash ^= static_cast<unsigned char>(*position) * PRIME_5;
+    hash = std::rotl(hash, 11) * PRIME_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME_2;
+  hash ^= hash >> 29;
+  hash *= PRIME_3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+std::uint64_t fingerprint_file(const std::string &path) {
+  constexpr std::uintmax_t SAMPLE_SIZE{1U << 20U};
+
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    throw std::runtime_error{"Cannot fingerprint file: " + path};
+  }
+
+  const auto file_size = std::filesystem::file_size(path);
+  const auto modification_time =
+      std::filesystem::last_write_time(path).time_since_epoch().count();
+
+  std::uint64_t fingerprint = hash_bytes(
+      {reinterpret_cast<const char *>(&file_size), sizeof(file_size)});
+  fingerprint =
+      hash_bytes({reinterpret_cast<const char *>(&modification_time),
+                  sizeof(modification_time)},
+                 fingerprint);
+
+  std::vector<char> sample(std::min(SAMPLE_SIZE, file_size));
+  file.read(sample.data(), sample.size());
+  fingerprint = hash_bytes({sample.data(), sample.size()}, fingerprint);
+
+  if (file_size > SAMPLE_SIZE) {
+    file.seekg(file_size - sample.size());
+    file.read(sample.data(), sample.size());
+    fingerprint = hash_bytes({sample.data(), sample.size()}, fingerprint);
+  }
+
+  if (!file) {
+    throw std::runtime_error{"Cannot fingerprint file: " + path};
+  }
+
+  return fingerprint;
+}
+
+std::string to_hex(const std::uint64_t hash) {
+  constexpr char DIGITS[] = "0123456789abcdef";
+  std::string hex(16U, '0');
+  for (int i = 15; i >= 0; --i) {
+    hex[i] = DIGITS[(hash >> ((15 - i) * 4)) & 0xFU];
+  }
+  return hex;
+}
+} // namespace model_wrapper
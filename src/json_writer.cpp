@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: json_writer.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "json_writer.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+namespace model_wrapper {
+
+void JsonWriter::append_key(const std::string_view key) {
+  if (m_buffer.size() > 1U) {
+    m_buffer.push_back(',');
+  }
+  m_buffer.push_back('"');
+  m_buffer.append(escape(key));
+  m_buffer.append("\":");
+}
+
+std::string JsonWriter::escape(const std::string_view text) {
+  std::string escaped;
+  escaped.reserve(text.size());
+
+  for (const char character : text) {
+    switch (character) {
+    case '"':
+      escaped.append("\\\"");
+      break;
+    case '\\':
+      escaped.append("\\\\");
+      break;
+    case '\n':
+      escaped.append("\\n");
+      break;
+    case '\r':
+      escaped.append("\\r");
+      break;
+    case '\t':
+      escaped.append("\\t");
+      break;
+    default:
+      if (static_cast<unsigned char>(character) < 0x20U) {
+        char code[8];
+        std::snprintf(code, sizeof(code), "\\u%04x",
+                      static_cast<unsigned int>(character));
+        escaped.append(code);
+      } else {
+        escaped.push_back(character);
+      }
+    }
+  }
+
+  return escaped;
+}
+
+JsonWriter &JsonWriter::add(const std::string_view key,
+                            const std::string_view value) {
+  append_key(key);
+  m_buffer.push_back('"');
+  m_buffer.append(escape(value));
+  m_buffer.push_back('"');
+  return *this;
+}
+
+JsonWriter &JsonWriter::add(const std::string_view key, const char *value) {
+  return add(key, std::string_view{value});
+}
+
+JsonWriter &JsonWriter::add(const std::string_view key,
+                            const std::int64_t value) {
+  append_key(key);
+  m_buffer.append(std::to_string(value));
+  return *this;
+}
+
+JsonWriter &JsonWriter::add(const std::string_view key,
+                            const std::uint64_t value) {
+  append_key(key);
+  m_buffer.append(std::to_string(value));
+  return *this;
+}
+
+JsonWriter &JsonWriter::add(const std::string_view key, const double value) {
+  append_key(key);
+
+  // JSON has no representation for NaN and infinity
+  if (!std::isfinite(value)) {
+    m_buffer.append("null");
+    return *this;
+  }
+
+  char number[32];
+  std::snprintf(number, sizeof(number), "%.3f", value);
+  m_buffer.append(number);
+  return *this;
+}
+
+JsonWriter &JsonWriter::add(const std::string_view key, const bool value) {
+  append_key(key);
+  m_buffer.append(value ? "true" : "false");
+  return *this;
+}
+
+JsonWriter &JsonWriter::add_raw(const std::string_view key,
+                                const std::string_view json) {
+  append_key(key);
+  m_buffer.append(json);
+  return *this;
+}
+
+std::string JsonWriter::str() const { return m_buffer + "}"; }
+} // namespace model_wrapper
@@ -0,0 +1,462 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: log_deduplicator.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "log_deduplicator.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace model_wrapper {
+
+namespace {
+/**
+ * \brief Hash of every run of words with digits
+ */
+constexpr std::uint64_t VOLATILE_HASH{0x9e3779b97f4a7c15ULL};
+
+/**
+ * \brief Character classes used by the normalization
+ */
+enum class CharacterClass : std::uint8_t { SPACE, WORD, DIGIT, OTHER };
+
+constexpr std::array<CharacterClass, 256U> make_character_classes() {
+  std::array<CharacterClass, 256U> classes{};
+  for (std::size_t i = 0U; i < classes.size(); ++i) {
+    const auto character = static_cast<char>(i);
+    if (character == ' ' || character == '\t' || character == '\r' ||
+        character == '\v' || character == '\f') {
+      classes[i] = CharacterClass::SPACE;
+    } else if (character >= '0' && character <= '9') {
+      classes[i] = CharacterClass::DIGIT;
+    } else if ((character >= 'a' && character <= 'z') ||
+               (character >= 'A' && character <= 'Z') || character == '_' ||
+               i >= 0x80U) {
+      classes[i] = CharacterClass::WORD;
+    } else {
+      classes[i] = CharacterClass::OTHER;
+    }
+  }
+  return classes;
+}
+
+constexpr auto CHARACTER_CLASSES = make_character_classes();
+
+CharacterClass get_class(const char character) {
+  return CHARACTER_CLASSES[static_cast<unsigned char>(character)];
+}
+
+constexpr std::uint64_t mix(std::uint64_t value) {
+  value ^= value >> 33U;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33U;
+  value *= 0xc4ceb53a3999fe4fULL;
+  return value ^ (value >> 33U);
+}
+
+/**
+ * \brief Visit the normalized features of a line
+ * \details A feature is a word or a single punctuation character,
+ * whitespace only separates. Words with digits and the punctuation between
+ * them, like timestamps, IDs and addresses, become a single feature with the
+ * same hash everywhere.
+ */
+template <typename Visitor>
+void visit_features(const std::string_view line, Visitor &&visitor) {
+  const char *position = line.data();
+  const char *const end = position + line.size();
+  bool is_volatile{false};
+
+  while (position < end) {
+    const auto character_class = get_class(*position);
+    if (character_class == CharacterClass::SPACE) {
+      is_volatile = false;
+      ++position;
+      continue;
+    }
+    if (character_class == CharacterClass::OTHER) {
+      if (!is_volatile) {
+        visitor(mix(static_cast<unsigned char>(*position) + 1U));
+      }
+      ++position;
+      continue;
+    }
+
+    // Bytes are hashed eight at a time while the word is scanned
+    std::uint64_t hash{0U};
+    std::uint64_t chunk{0U};
+    std::size_t chunk_size{0U};
+    bool has_digit{false};
+    for (; position < end; ++position) {
+      const auto word_class = get_class(*position);
+      if (word_class == CharacterClass::DIGIT) {
+        has_digit = true;
+      } else if (word_class != CharacterClass::WORD) {
+        break;
+      }
+      chunk |= static_cast<std::uint64_t>(static_cast<unsigned char>(*position))
+               << (chunk_size * 8U);
+      if (++chunk_size == 8U) {
+        hash = mix(hash ^ chunk);
+        chunk = 0U;
+        chunk_size = 0U;
+      }
+    }
+
+    if (!has_digit) {
+      visitor(mix(hash ^ chunk ^ (chunk_size << 56U)));
+      is_volatile = false;
+    } else if (!is_volatile) {
+      visitor(VOLATILE_HASH);
+      is_volatile = true;
+    }
+  }
+}
+
+/**
+ * \brief Hashes of a normalized line
+ */
+struct LineHashes {
+  /**
+   * \brief Equal for lines that are equal after normalization
+   */
+  std::uint64_t hash{0U};
+
+  /**
+   * \brief Differs in few bits for lines with mostly the same features
+   */
+  std::uint64_t simhash{0U};
+};
+
+/**
+ * \brief Hash the normalized line in a single pass
+ * \details The simhash keeps one byte-wide counter per bit, eight of them
+ * packed into a word, so a feature costs eight additions instead of one per
+ * bit and the majority of every counter is found with a few word
+ * operations. Only the first SIMHASH_FEATURES features count for the
+ * simhash so the counters cannot overflow.
+ */
+LineHashes hash_line(const std::string_view line) {
+  constexpr std::uint64_t LOW_BITS{0x0101010101010101ULL};
+  constexpr std::uint64_t HIGH_BITS{0x8080808080808080ULL};
+  constexpr std::size_t SIMHASH_FEATURES{127U};
+
+  std::array<std::uint64_t, 8U> packed_counts{};
+  std::size_t number_of_features{0U};
+  LineHashes hashes{};
+  visit_features(line, [&](const std::uint64_t feature) {
+    hashes.hash = mix(hashes.hash ^ feature);
+    if (number_of_features < SIMHASH_FEATURES) {
+      for (std::size_t shift = 0U; shift < packed_counts.size(); ++shift) {
+        packed_counts[shift] += (feature >> shift) & LOW_BITS;
+      }
+      ++number_of_features;
+    }
+  });
+
+  // A bit is set when it is set in more than half of the features, the
+  // high bit of every counter tells if it reached the threshold
+  const auto threshold = (number_of_features / 2U + 1U) * LOW_BITS;
+  for (std::size_t shift = 0U; shift < packed_counts.size(); ++shift) {
+    const auto is_set =
+        ((packed_counts[shift] | HIGH_BITS) - threshold) & HIGH_BITS;
+    hashes.simhash |= (is_set >> 7U) << shift;
+  }
+  return hashes;
+}
+
+/**
+ * \brief A kept line and how many lines it stands for
+ */
+struct Unit {
+  std::string_view line;
+  LineHashes hashes{};
+  std::size_t count{1U};
+};
+
+/**
+ * \brief Tell if two lines are equal after normalization or near
+ * duplicates
+ */
+bool is_similar(const Unit &lhs, const Unit &rhs,
+                const std::size_t max_distance) {
+  return lhs.hashes.hash == rhs.hashes.hash ||
+         static_cast<std::size_t>(
+             std::popcount(lhs.hashes.simhash ^ rhs.hashes.simhash)) <=
+             max_distance;
+}
+
+/**
+ * \brief Collapses the runs of similar lines of one text, see
+ * LogDeduplicator
+ */
+class Collapser {
+private:
+  const DedupSettings &m_settings;
+  DedupResult &m_result;
+  Unit m_run{};
+  bool m_has_run{false};
+
+  // Units that may still start a repeated block, at most twice the longest
+  // block so a vector is cheaper than a deque
+  std::vector<Unit> m_pending;
+  std::size_t m_block_lines{0U};
+  std::size_t m_block_repeats{0U};
+  std::size_t m_matched_lines{0U};
+
+  void write(const Unit &unit) {
+    m_result.text.append(unit.line);
+    if (unit.count > 1U) {
+      m_result.text.append(" [repeated ")
+          .append(std::to_string(unit.count))
+          .append(" times]");
+    }
+    m_result.text.push_back('\n');
+    ++m_result.output_lines;
+  }
+
+  void write_block() {
+    for (std::size_t i = 0U; i < m_block_lines; ++i) {
+      write(m_pending[i]);
+    }
+    m_result.text.append("[previous ")
+        .append(std::to_string(m_block_lines))
+        .append(" lines repeated ")
+        .append(std::to_string(m_block_repeats + 1U))
+        .append(" times]\n");
+    ++m_result.output_lines;
+  }
+
+  /**
+   * \brief Enter the block state if the last units repeat the ones before
+   */
+  void find_block() {
+    const auto size = m_pending.size();
+    for (std::size_t lines = 2U;
+         lines <= m_settings.max_block_lines && 2U * lines <= size; ++lines) {
+      bool is_repeated{true};
+      for (auto i = size; i > size - lines && is_repeated; --i) {
+        is_repeated = m_pending[i - 1U].hashes.hash ==
+                      m_pending[i - 1U - lines].hashes.hash;
+      }
+      if (!is_repeated) {
+        continue;
+      }
+
+      // Only the first occurrence of the block stays pending
+      const auto block_start = m_pending.begin() + (size - 2U * lines);
+      for (auto unit = m_pending.begin(); unit != block_start; ++unit) {
+        write(*unit);
+      }
+      m_pending.erase(m_pending.begin(), block_start);
+      m_pending.resize(lines);
+      m_block_lines = lines;
+      m_block_repeats = 1U;
+      m_matched_lines = 0U;
+      return;
+    }
+  }
+
+  void add_unit(const Unit &unit) {
+    if (m_block_lines > 0U) {
+      if (unit.hashes.hash == m_pending[m_matched_lines].hashes.hash) {
+        if (++m_matched_lines == m_block_lines) {
+          ++m_block_repeats;
+          m_matched_lines = 0U;
+        }
+        return;
+      }
+
+      // The block ends, the partly matched repeat is added line by line
+      write_block();
+      const std::vector<Unit> partial{m_pending.begin(),
+                                      m_pending.begin() + m_matched_lines};
+      m_pending.clear();
+      m_block_lines = 0U;
+      for (const auto &matched : partial) {
+        add_unit(matched);
+      }
+      add_unit(unit);
+      return;
+    }
+
+    m_pending.push_back(unit);
+    find_block();
+    if (m_block_lines == 0U &&
+        m_pending.size() > 2U * m_settings.max_block_lines) {
+      write(m_pending.front());
+      m_pending.erase(m_pending.begin());
+    }
+  }
+
+public:
+  Collapser(const DedupSettings &settings, DedupResult &result)
+      : m_settings(settings), m_result(result) {}
+
+  /**
+   * \brief Add the next run of similar lines
+   */
+  void add_run(const Unit &unit) {
+    if (m_has_run && is_similar(m_run, unit, m_settings.max_distance)) {
+      m_run.count += unit.count;
+      return;
+    }
+    if (m_has_run) {
+      add_unit(m_run);
+    }
+    m_run = unit;
+    m_has_run = true;
+  }
+
+  void finish() {
+    if (m_has_run) {
+      add_unit(m_run);
+      m_has_run = false;
+    }
+    if (m_block_lines > 0U) {
+      // Lines of an unfinished repeat are written as they are
+      write_block();
+      for (std::size_t i = 0U; i < m_matched_lines; ++i) {
+        write(m_pending[i]);
+      }
+      m_pending.clear();
+      m_block_lines = 0U;
+    }
+    for (const auto &unit : m_pending) {
+      write(unit);
+    }
+    m_pending.clear();
+  }
+};
+
+/**
+ * \brief Input size hashed by one thread at a time
+ */
+constexpr std::size_t SEGMENT_SIZE{1024U * 1024U};
+
+/**
+ * \brief Segments per thread hashed before they are collapsed, bounds the
+ * memory of the hashed lines
+ */
+constexpr std::size_t SEGMENTS_PER_THREAD{4U};
+
+/**
+ * \brief Part of the text hashed by one thread
+ */
+struct Segment {
+  std::string_view text;
+  std::vector<Unit> units;
+  std::size_t number_of_lines{0U};
+};
+
+/**
+ * \brief Hash the lines of the segment and join the runs of similar lines
+ */
+void hash_segment(Segment &segment, const DedupSettings &settings) {
+  segment.units.clear();
+  segment.number_of_lines = 0U;
+
+  const auto text = segment.text;
+  std::size_t line_start{0U};
+  while (line_start < text.size()) {
+    const auto *const line_end = static_cast<const char *>(std::memchr(
+        text.data() + line_start, '\n', text.size() - line_start));
+    const auto line_size =
+        line_end != nullptr
+            ? static_cast<std::size_t>(line_end - text.data()) - line_start
+            : text.size() - line_start;
+    const auto line = text.substr(line_start, line_size);
+    line_start += line_size + 1U;
+    ++segment.number_of_lines;
+
+    const Unit unit{line, hash_line(line)};
+    if (!segment.units.empty() &&
+        is_similar(segment.units.back(), unit, settings.max_distance)) {
+      ++segment.units.back().count;
+    } else {
+      segment.units.push_back(unit);
+    }
+  }
+}
+} // namespace
+
+LogDeduplicator::LogDeduplicator(DedupSettings settings)
+    : m_settings(std::move(settings)) {}
+
+DedupResult LogDeduplicator::deduplicate(const std::string_view text) const {
+  DedupResult result{};
+  result.text.reserve(text.size() / 4U);
+  Collapser collapser{m_settings, result};
+
+  const auto number_of_threads =
+      m_settings.number_of_threads > 0U
+          ? m_settings.number_of_threads
+          : std::max(1U, std::thread::hardware_concurrency());
+  std::vector<Segment> hashed(number_of_threads * SEGMENTS_PER_THREAD);
+  std::vector<Segment> hashing(hashed.size());
+  std::size_t number_of_hashed{0U};
+
+  const auto collapse_hashed = [&]() {
+    for (std::size_t i = 0U; i < number_of_hashed; ++i) {
+      result.input_lines += hashed[i].number_of_lines;
+      for (const auto &unit : hashed[i].units) {
+        collapser.add_run(unit);
+      }
+    }
+  };
+
+  // Segments are cut at line ends with a fixed size, so the result does not
+  // depend on the number of threads
+  std::size_t position{0U};
+  while (position < text.size()) {
+    std::size_t number_of_segments{0U};
+    for (; number_of_segments < hashing.size() && position < text.size();
+         ++number_of_segments) {
+      auto end = std::min(text.size(), position + SEGMENT_SIZE);
+      if (end < text.size()) {
+        const auto line_end = text.find('\n', end);
+        end = line_end != std::string_view::npos ? line_end + 1U : text.size();
+      }
+      hashing[number_of_segments].text = text.substr(position, end - position);
+      position = end;
+    }
+
+    // The previous segments are collapsed while the next ones are hashed
+    std::atomic<std::size_t> next_segment{0U};
+    {
+      std::vector<std::jthread> workers;
+      for (std::size_t i = 0U;
+           i < std::min(number_of_threads, number_of_segments); ++i) {
+        workers.emplace_back([&]() {
+          for (auto index = next_segment++; index < number_of_segments;
+               index = next_segment++) {
+            hash_segment(hashing[index], m_settings);
+          }
+        });
+      }
+      collapse_hashed();
+    }
+
+    std::swap(hashed, hashing);
+    number_of_hashed = number_of_segments;
+  }
+  collapse_hashed();
+  collapser.finish();
+
+  return result;
+}
+} // namespace model_wrapper
@@ -10,61 +10,681 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "argument_parser.h"
+#include "batch_runner.h"
+#include "cache_directory.h"
+#include "chunked_summarizer.h"
+#include "cpu_placement.h"
+#include "hash.h"
+#include "mapped_file.h"
 #include "model.h"
+#include "output_sink.h"
+#include "prefix_cache.h"
+#include "startup.h"
+#include "stats_report.h"
+#include "summary_cache.h"
+#include "summary_server.h"
+#include "thread_tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
 #include <string>
-#include <vector>
+#include <string_view>
+#include <thread>
+
+namespace {
+/**
+ * \brief Write the stats record to stderr or to the given file
+ */
+void write_stats(const std::string &stats_path,
+                 const model_wrapper::SummaryStats &stats,
+                 const model_wrapper::RunTimings &timings) {
+  const auto record = model_wrapper::make_stats_record(stats, timings);
+  if (stats_path.empty()) {
+    std::cerr << record << std::endl;
+    return;
+  }
+
+  std::ofstream stats_file{stats_path, std::ios::app};
+  if (!stats_file) {
+    throw std::runtime_error{"Cannot open stats file: " + stats_path};
+  }
+  stats_file << record << std::endl;
+}
+/**
+ * \brief Collect the timings of the run outside of the responses
+ */
+model_wrapper::RunTimings get_run_timings(
+    const model_wrapper::Model &model,
+    model_wrapper::StartupTimings startup_timings,
+    const std::optional<model_wrapper::WeightPrefetcher> &prefetcher,
+    const double total_ms) {
+  if (prefetcher) {
+    startup_timings.prefetch_submit_ms = prefetcher->get_prefetch_submit_ms();
+    startup_timings.prefetched_bytes = prefetcher->get_prefetched_bytes();
+  }
+
+  const auto &piece_table = model.get_piece_table();
+  return {model.get_load_ms(), total_ms, piece_table.get_build_ms(),
+          piece_table.get_memory_bytes(), startup_timings};
+}
+
+/**
+ * \brief Describe everything besides the document that decides a summary
+ */
+std::string describe_summary_configuration(
+    const std::string &model_path, const float temperature,
+    const model_wrapper::SummaryPrompt &summary_prompt,
+    const model_wrapper::ChunkingSettings &chunking_settings,
+    const std::optional<model_wrapper::DedupSettings> &dedup_settings,
+    const model_wrapper::ContextSettings &context_settings,
+    const std::size_t prediction_length) {
+  return model_wrapper::to_hex(model_wrapper::fingerprint_file(model_path)) +
+         "\ntemperature=" + std::to_string(temperature) + "\n" +
+         model_wrapper::SamplerSettings{}.describe() + "\n" +
+         summary_prompt.system_prompt + "\n" +
+         summary_prompt.user_prompt_end + "\nchunk_tokens=" +
+         std::to_string(chunking_settings.chunk_tokens) +
+         " overlap_tokens=" + std::to_string(chunking_settings.overlap_tokens) +
+         " token_budget=" + std::to_string(chunking_settings.token_budget) +
+         " dedup_distance=" +
+         (dedup_settings ? std::to_string(dedup_settings->max_distance)
+                         : std::string{"off"}) +
+         " cache_type_k=" + ggml_type_name(context_settings.type_k) +
+         " cache_type_v=" + ggml_type_name(context_settings.type_v) +
+         " flash_attention=" +
+         std::to_string(context_settings.flash_attention) +
+         " prediction_length=" + std::to_string(prediction_length);
+}
+
+/**
+ * \brief Get the file of a named session, sessions of different models are
+ * kept apart
+ */
+std::filesystem::path get_session_path(const std::filesystem::path &directory,
+                                       const std::string &session_name,
+                                       const std::string &model_path) {
+  return directory /
+         (model_wrapper::to_hex(model_wrapper::hash_bytes(session_name)) +
+          "-" +
+          model_wrapper::to_hex(model_wrapper::fingerprint_file(model_path)) +
+          ".session");
+}
+
+/**
+ * \brief Complete the thread counts not given on the command line with the
+ * tuned ones of the model, if there are any
+ */
+model_wrapper::ThreadConfig
+get_thread_config(model_wrapper::ThreadConfig config,
+                  const std::string &tune_path, const std::string &model_path) {
+  if (config.n_threads > 0U && config.n_threads_batch > 0U) {
+    return config;
+  }
+
+  if (const auto tuned =
+          model_wrapper::ThreadTuner{tune_path, model_path}.load();
+      tuned) {
+    if (config.n_threads == 0U) {
+      config.n_threads = tuned->n_threads;
+    }
+    if (config.n_threads_batch == 0U) {
+      config.n_threads_batch = tuned->n_threads_batch;
+    }
+  }
+  return config;
+}
+} // namespace
 
 int main(int argc, char *argv[]) {
+  const auto start_time = std::chrono::steady_clock::now();
   try {
     // Parse command line arguments
-    ArgumentParser parser{"Document Summarizer\nIt reads from stdin and "
-                          "summarizes the input text with the given model."};
+    ArgumentParser parser{
+        "Document Summarizer\nIt reads from stdin and summarizes the input "
+        "text with the given model.\nIn batch mode the files, directories "
+        "and manifest entries given as arguments are summarized into JSON "
+        "lines with a single loaded model.\nWith --serve the model stays "
+        "loaded and serves --connect clients over a Unix socket."};
+    // Contexts use 4 threads by default, serve as many clients as cores
+    // allow
+    const int default_clients =
+        std::max(1U, std::thread::hardware_concurrency() / 4U);
+    // Every chunk context is close to the trained context size, so only two
+    // run at once unless asked for, to keep the peak memory bounded
+    const int default_jobs = std::min(default_clients, 2);
     parser.add_option<float>("temperature", "t", "The temperature", false, 0.5f)
         .add_option<std::string>("model", "m", "The path to the model file",
                                  false, std::string{DEFAULT_MODEL_PATH})
+        .add_option<int>("chunk-size", "",
+                         "Max tokens per chunk (0 = fit model context)", false,
+                         0)
+        .add_option<int>("chunk-overlap", "",
+                         "Tokens shared by neighbouring chunks", false, 128)
+        .add_option<int>("jobs", "j", "Number of chunks summarized in parallel",
+                         false, default_jobs)
+        .add_flag("dedup", "",
+                  "Collapse repeated and near-duplicate lines and blocks "
+                  "before tokenizing",
+                  false)
+        .add_option<int>("dedup-distance", "",
+                         "Max differing simhash bits of near-duplicate lines "
+                         "(dedup)",
+                         false, 3)
+        .add_option<int>("token-budget", "",
+                         "Max document tokens given to the model, larger "
+                         "documents keep their most informative sentences "
+                         "(0 = all)",
+                         false, 0)
+        .add_option<std::string>("prefix-cache", "",
+                                 "Directory to cache the system prompt state",
+                                 false, std::string{})
+        .add_flag("prefix-cache-clear", "",
+                  "Remove all entries from the prefix cache", false)
+        .add_option<std::string>("summary-cache", "",
+                                 "Directory to cache finished summaries",
+                                 false, std::string{})
+        .add_option<int>("summary-cache-size", "",
+                         "Size limit of the summary cache in MiB", false, 256)
+        .add_option<std::string>("session", "",
+                                 "Name of the document, a later run of the "
+                                 "same name only evaluates what changed",
+                                 false, std::string{})
+        .add_option<std::string>(
+            "session-dir", "", "Directory to keep the sessions in", false,
+            (model_wrapper::get_default_cache_directory() / "sessions")
+                .string())
+        .add_option<std::string>("input", "i",
+                                 "Summarize this file instead of stdin, it "
+                                 "is memory mapped",
+                                 false, std::string{})
+        .add_flag("stream", "",
+                  "Start evaluating stdin while it is still being read", false)
+        .add_flag("follow", "f",
+                  "Keep reading stdin and summarize its latest lines "
+                  "periodically",
+                  false)
+        .add_option<int>("follow-lines", "",
+                         "New lines between two summaries (follow)", false,
+                         100)
+        .add_option<int>("follow-interval", "",
+                         "Max seconds between two summaries (follow)", false,
+                         60)
+        .add_flag("batch", "b", "Summarize the given files as JSON lines",
+                  false)
+        .add_option<std::string>("manifest", "",
+                                 "File with one input path per line (batch)",
+                                 false, std::string{})
+        .add_option<std::string>("output", "o",
+                                 "File to write the JSON lines to (batch)",
+                                 false, std::string{})
+        .add_option<int>("sequences", "s",
+                         "Documents decoded together in one context (batch)",
+                         false, 1)
+        .add_option<std::string>("serve", "",
+                                 "Serve requests on this Unix socket", false,
+                                 std::string{})
+        .add_option<std::string>("connect", "",
+                                 "Summarize stdin with the server on this "
+                                 "Unix socket",
+                                 false, std::string{})
+        .add_option<int>("max-clients", "",
+                         "Clients served at the same time (serve)", false,
+                         default_clients)
+        .add_option<int>("max-idle-tokens", "",
+                         "Total size of the idle contexts kept for reuse "
+                         "(0 = twice the trained context)",
+                         false, 0)
+        .add_option<int>("batch-size", "",
+                         "Max prompt tokens submitted per decode", false,
+                         2048)
+        .add_option<int>("ubatch-size", "",
+                         "Max tokens computed at once in a decode", false, 512)
+        .add_flag("low-memory", "",
+                  "Quantize the K/V cache to q8_0 and use flash attention",
+                  false)
+        .add_option<std::string>("cache-type-k", "",
+                                 "K cache type: f16, q8_0, q4_0, ... "
+                                 "(default f16, q8_0 with low-memory)",
+                                 false, std::string{})
+        .add_option<std::string>("cache-type-v", "",
+                                 "V cache type, quantized types need flash "
+                                 "attention",
+                                 false, std::string{})
+        .add_option<std::string>("flash-attn", "",
+                                 "Flash attention: on, off or auto (default "
+                                 "auto, on with low-memory)",
+                                 false, std::string{})
+        .add_flag("no-mmap", "",
+                  "Read the model into memory instead of mapping it", false)
+        .add_flag("mlock", "", "Keep the model weights locked in RAM", false)
+        .add_flag("no-prefetch", "",
+                  "Do not read the model file ahead while the model is loaded",
+                  false)
+        .add_flag("warmup", "",
+                  "Evaluate a token before the input to take the cost of "
+                  "the first decode",
+                  false)
+        .add_flag("memory-estimate", "",
+                  "Print the estimated memory for the input as JSON and "
+                  "exit",
+                  false)
+        .add_option<std::string>("draft-model", "",
+                                 "Small model with the same vocabulary that "
+                                 "drafts tokens for speculative decoding",
+                                 false, std::string{})
+        .add_flag("prompt-lookup", "",
+                  "Draft tokens by copying from the input, no second model",
+                  false)
+        .add_option<int>("draft-max", "",
+                         "Max tokens drafted per step (draft-model, "
+                         "prompt-lookup)",
+                         false, 16)
+        .add_option<int>("threads", "",
+                         "Threads for generating tokens (0 = tuned or "
+                         "default)",
+                         false, 0)
+        .add_option<int>("threads-batch", "",
+                         "Threads for evaluating prompts (0 = tuned or "
+                         "default)",
+                         false, 0)
+        .add_option<std::string>("cpus", "",
+                                 "Run only on these CPUs, e.g. 0-15,32-47",
+                                 false, std::string{})
+        .add_option<std::string>("numa", "",
+                                 "NUMA placement: none, distribute, "
+                                 "isolate, numactl or mirror",
+                                 false, std::string{})
+        .add_flag("autotune", "",
+                  "Measure the best thread counts for the model and save "
+                  "them for later runs",
+                  false)
+        .add_option<std::string>(
+            "tune-file", "", "File with the tuned thread counts", false,
+            model_wrapper::ThreadTuner::get_default_cache_path().string())
+        .add_option<std::string>("flush", "",
+                                 "Output flush policy: token, line, "
+                                 "tokens:N, ms:M or end",
+                                 false, std::string{})
+        .add_flag("stats", "",
+                  "Write phase timings and token counts as JSON to stderr",
+                  false)
+        .add_option<std::string>("stats-output", "",
+                                 "Append the stats JSON to this file instead",
+                                 false, std::string{})
         .parse(argc, argv);
 
+    // Thin client, the server has the model loaded already
+    if (const auto socket_path = parser.get_option<std::string>("connect");
+        !socket_path.empty()) {
+      model_wrapper::SummaryClient{socket_path}.summarize(std::cin, std::cout);
+      return 0;
+    }
+
+    // Threads inherit the placement, so it is set before any is started
+    if (const auto cpus = parser.get_option<std::string>("cpus");
+        !cpus.empty()) {
+      model_wrapper::set_cpu_affinity(model_wrapper::parse_cpu_list(cpus));
+    }
+    if (const auto numa = parser.get_option<std::string>("numa");
+        !numa.empty()) {
+      llama_backend_init();
+      llama_numa_init(model_wrapper::parse_numa_strategy(numa));
+    }
+
     const auto temperature = parser.get_option<float>("temperature");
     const auto model_path = parser.get_option<std::string>("model");
+    const auto tune_path = parser.get_option<std::string>("tune-file");
+    const model_wrapper::ChunkingSettings chunking_settings{
+        static_cast<std::size_t>(
+            std::max(0, parser.get_option<int>("chunk-size"))),
+        static_cast<std::size_t>(
+            std::max(0, parser.get_option<int>("chunk-overlap"))),
+        static_cast<std::size_t>(std::max(1, parser.get_option<int>("jobs"))),
+        static_cast<std::size_t>(
+            std::max(0, parser.get_option<int>("token-budget")))};
+    std::optional<model_wrapper::DedupSettings> dedup_settings;
+    if (parser.get_option<bool>("dedup")) {
+      dedup_settings.emplace();
+      dedup_settings->max_distance = static_cast<std::size_t>(
+          std::max(0, parser.get_option<int>("dedup-distance")));
+    }
+    const auto prefix_cache_directory =
+        parser.get_option<std::string>("prefix-cache");
+
+    // The low memory profile only fills in what is not given explicitly
+    const bool is_low_memory = parser.get_option<bool>("low-memory");
+    model_wrapper::ContextSettings context_settings{};
+    const auto get_memory_option = [&](const std::string &name,
+                                       const std::string &default_value,
+                                       const std::string &low_memory_value) {
+      const auto value = parser.get_option<std::string>(name);
+      return !value.empty() ? value
+             : is_low_memory ? low_memory_value
+                             : default_value;
+    };
+    context_settings.type_k = model_wrapper::parse_cache_type(
+        get_memory_option("cache-type-k", "f16", "q8_0"));
+    context_settings.type_v = model_wrapper::parse_cache_type(
+        get_memory_option("cache-type-v", "f16", "q8_0"));
+    context_settings.flash_attention = model_wrapper::parse_flash_attention(
+        get_memory_option("flash-attn", "auto", "on"));
+    model_wrapper::LoadSettings load_settings{};
+    load_settings.is_memory_mapped = !parser.get_option<bool>("no-mmap");
+    load_settings.is_memory_locked = parser.get_option<bool>("mlock");
+
+    if (parser.get_option<bool>("prefix-cache-clear") &&
+        !prefix_cache_directory.empty()) {
+      const auto number_of_removed =
+          model_wrapper::PrefixCache::clear(prefix_cache_directory);
+      std::cerr << "Removed " << number_of_removed
+                << " prefix cache entries" << std::endl;
+    }
+
+    const auto stats_path = parser.get_option<std::string>("stats-output");
+    const bool is_stats_enabled =
+        parser.get_option<bool>("stats") || !stats_path.empty();
+    const auto total_ms = [&start_time]() {
+      return std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start_time)
+          .count();
+    };
 
     const std::int32_t number_of_gpu_layers{99};
     const std::size_t prediction_length{512U};
 
-    // Read prompt_context from stdin
-    const std::string prompt_context{std::istreambuf_iterator<char>(std::cin),
-                                     std::istreambuf_iterator<char>()};
+    if (parser.get_option<bool>("autotune")) {
+      model_wrapper::Model model{model_path, temperature, number_of_gpu_layers,
+                                 prediction_length, load_settings};
+      const auto config =
+          model_wrapper::ThreadTuner{tune_path, model_path}.tune(model,
+                                                                 std::cerr);
+      std::cout << "Threads: " << config.n_threads
+                << ", batch threads: " << config.n_threads_batch
+                << ", saved to " << tune_path << std::endl;
+      return 0;
+    }
+
+    const auto server_socket_path = parser.get_option<std::string>("serve");
+    const bool is_server_mode = !server_socket_path.empty();
+    const bool is_batch_mode = parser.get_option<bool>("batch");
+    // Summaries are shown as they are generated, JSON lines once complete
+    const auto flush_policy = parser.get_option<std::string>("flush");
+    const auto flush_settings = model_wrapper::parse_flush_settings(
+        !flush_policy.empty() ? flush_policy
+        : is_batch_mode       ? "line"
+                              : "token");
+
+    const auto input_path = parser.get_option<std::string>("input");
+    // The estimate needs the whole document before anything is summarized
+    const bool is_estimate_mode = parser.get_option<bool>("memory-estimate") &&
+                                  !is_batch_mode && !is_server_mode;
+    const bool is_follow_mode = parser.get_option<bool>("follow") &&
+                                !is_batch_mode && !is_server_mode &&
+                                !is_estimate_mode && input_path.empty();
+    const bool is_stream_mode = parser.get_option<bool>("stream") &&
+                                !is_batch_mode && !is_server_mode &&
+                                !is_follow_mode && !is_estimate_mode &&
+                                input_path.empty();
+    model_wrapper::BatchRunner batch_runner;
+    std::optional<model_wrapper::MappedFile> input_file;
+    std::string prompt_context;
+    std::string_view document;
+
+    if (is_batch_mode) {
+      for (const auto &path : parser.get_positional()) {
+        batch_runner.add_path(path);
+      }
+      if (const auto manifest = parser.get_option<std::string>("manifest");
+          !manifest.empty()) {
+        batch_runner.add_manifest(manifest);
+      }
+    } else if (is_stream_mode || is_follow_mode) {
+      // The input is read while summarizing, only wait for its first byte
+      std::cin.peek();
+    } else if (!is_server_mode && !input_path.empty()) {
+      // Large inputs are used in place instead of being copied to the heap
+      input_file.emplace(input_path);
+      document = input_file->get_view();
+    } else if (!is_server_mode) {
+      // Read prompt_context from stdin
+      prompt_context.assign(std::istreambuf_iterator<char>(std::cin),
+                            std::istreambuf_iterator<char>());
+      document = prompt_context;
+    }
 
     // Check if anything was provided
-    if (prompt_context.empty()) {
+    const bool is_input_empty =
+        is_batch_mode    ? batch_runner.get_inputs().empty()
+        : is_stream_mode || is_follow_mode ? std::cin.eof()
+                         : document.empty();
+    if (!is_server_mode && is_input_empty) {
       std::cout << "Nothing to summarize!" << std::endl;
       return 0;
     }
 
-    std::cout << "Model path: " << model_path << std::endl;
-
     // Set the system and user prompts
-    const std::string system_prompt{
+    model_wrapper::SummaryPrompt summary_prompt{
         "You are a document summarizer. User will provide a technical text and "
         "you will summarize it. Be brief and direct. Include only essential "
         "information. Keep your summary short with few sentences. Only focus "
         "on human readable text. Write ONLY 3-5 sentences, then "
-        "stop.\n\nTEXT:\n"};
-    const std::string user_prompt_end{"\n\nSHORT SUMMARY (Be brief and "
-                                      "precise, stop after 3-5 sentences):\n"};
+        "stop.\n\nTEXT:\n",
+        "\n\nSHORT SUMMARY (Be brief and precise, stop after 3-5 "
+        "sentences):\n"};
+
+    // Repeated documents are answered from the cache without the model
+    std::optional<model_wrapper::SummaryCache> summary_cache;
+    if (const auto directory = parser.get_option<std::string>("summary-cache");
+        !directory.empty() && !is_server_mode) {
+      summary_cache.emplace(
+          directory,
+          static_cast<std::uintmax_t>(
+              std::max(1, parser.get_option<int>("summary-cache-size"))) *
+              1024U * 1024U,
+          describe_summary_configuration(model_path, temperature,
+                                         summary_prompt, chunking_settings,
+                                         dedup_settings, context_settings,
+                                         prediction_length));
+      batch_runner.set_summary_cache(&*summary_cache);
+    }
+
+    // Streamed input is not known before it is summarized
+    std::string summary_key;
+    if (summary_cache && !is_batch_mode && !is_stream_mode &&
+        !is_follow_mode && !is_estimate_mode) {
+      summary_key = summary_cache->make_key(document);
+      if (const auto summary = summary_cache->lookup(summary_key); summary) {
+        std::cout << *summary << std::flush;
+        if (is_stats_enabled) {
+          write_stats(stats_path, {document.size(), 0U, 0U, 0U, 0U, 0U, {}},
+                      {0.0, total_ms(), 0.0, 0U});
+        }
+        return 0;
+      }
+    }
+
+    // The model is needed from here on, its weights are read from disk
+    // while it is loaded and the prompt is prepared
+    std::optional<model_wrapper::WeightPrefetcher> prefetcher;
+    if (!parser.get_option<bool>("no-prefetch")) {
+      prefetcher.emplace(model_path);
+    }
+    model_wrapper::StartupTimings startup_timings{};
+
+    std::filesystem::path session_path;
+    if (const auto session_name = parser.get_option<std::string>("session");
+        !session_name.empty() && !is_batch_mode && !is_stream_mode &&
+        !is_follow_mode && !is_server_mode) {
+      session_path =
+          get_session_path(parser.get_option<std::string>("session-dir"),
+                           session_name, model_path);
+    }
 
-    std::string user_prompt;
-    user_prompt.reserve(prompt_context.size() + user_prompt_end.size());
-    user_prompt.append(prompt_context).append(user_prompt_end);
+    // Keep stdout clean for the JSON lines in batch and estimate mode
+    (is_batch_mode || is_server_mode || is_estimate_mode ? std::cerr
+                                                         : std::cout)
+        << "Model path: " << model_path << std::endl;
 
-    std::vector<llama_chat_message> messages;
-    messages.push_back({"system", system_prompt.c_str()});
-    messages.push_back({"user", user_prompt.c_str()});
+    startup_timings.backend_ms = model_wrapper::initialize_backend();
+    auto model =
+        model_wrapper::Model{model_path, temperature, number_of_gpu_layers,
+                             prediction_length, load_settings};
+    const auto run_timings = [&]() {
+      return get_run_timings(model, startup_timings, prefetcher, total_ms());
+    };
+    // Keep an idle context for every concurrent generation
+    const auto max_concurrency = static_cast<std::size_t>(
+        std::max({1, parser.get_option<int>("jobs"),
+                  parser.get_option<int>("max-clients")}));
+    const auto thread_config = get_thread_config(
+        {static_cast<std::uint32_t>(
+             std::max(0, parser.get_option<int>("threads"))),
+         static_cast<std::uint32_t>(
+             std::max(0, parser.get_option<int>("threads-batch")))},
+        tune_path, model_path);
+    context_settings.n_batch = static_cast<std::uint32_t>(
+        std::max(1, parser.get_option<int>("batch-size")));
+    context_settings.n_ubatch = static_cast<std::uint32_t>(
+        std::max(1, parser.get_option<int>("ubatch-size")));
+    context_settings.max_idle_contexts = max_concurrency;
+    context_settings.max_idle_tokens = static_cast<std::size_t>(
+        std::max(0, parser.get_option<int>("max-idle-tokens")));
+    context_settings.n_threads = thread_config.n_threads;
+    context_settings.n_threads_batch = thread_config.n_threads_batch;
+    model.set_context_settings(context_settings);
 
-    auto model = model_wrapper::Model{model_path, temperature,
-                                      number_of_gpu_layers, prediction_length};
+    model_wrapper::SpeculativeSettings speculative_settings{};
+    speculative_settings.max_draft_tokens = static_cast<std::size_t>(
+        std::max(1, parser.get_option<int>("draft-max")));
+    if (const auto draft_model_path =
+            parser.get_option<std::string>("draft-model");
+        !draft_model_path.empty()) {
+      model.enable_draft_model(draft_model_path, number_of_gpu_layers,
+                               speculative_settings, load_settings);
+    } else if (parser.get_option<bool>("prompt-lookup")) {
+      model.enable_prompt_lookup(speculative_settings);
+    }
+
+    if (parser.get_option<bool>("warmup") && !is_estimate_mode) {
+      startup_timings.warmup_ms = model.warmup();
+    }
+
+    // Documents larger than the model context are summarized chunk by chunk
+    model_wrapper::ChunkedSummarizer summarizer{
+        model, std::move(summary_prompt), chunking_settings};
+
+    if (dedup_settings) {
+      summarizer.enable_deduplication(*dedup_settings);
+    }
+
+    // Only the document is tokenized, no context is created
+    if (is_estimate_mode) {
+      model_wrapper::SummaryStats stats{};
+      const auto tokens = summarizer.tokenize_document(document, stats);
+      std::cout << model_wrapper::make_memory_record(
+                       summarizer.estimate_memory(tokens.size()),
+                       context_settings, stats)
+                << std::endl;
+      return 0;
+    }
 
-    model.generate_response(model.get_formatted_prompt(messages), std::cout);
+    if (const auto prefix = summarizer.get_prompt_prefix();
+        !prefix_cache_directory.empty() && !prefix.empty()) {
+      model.enable_prefix_cache(prefix_cache_directory, prefix);
+    }
+
+    if (is_server_mode) {
+      const auto max_clients = static_cast<std::size_t>(
+          std::max(1, parser.get_option<int>("max-clients")));
+      model_wrapper::SummaryServer{summarizer, server_socket_path, max_clients}
+          .run();
+      return 0;
+    }
+
+    if (is_follow_mode) {
+      model_wrapper::FollowSettings follow_settings{};
+      follow_settings.summary_lines = static_cast<std::size_t>(
+          std::max(1, parser.get_option<int>("follow-lines")));
+      follow_settings.summary_interval = std::chrono::seconds{
+          std::max(1, parser.get_option<int>("follow-interval"))};
+
+      // Every summary gets its own stats record
+      model_wrapper::OutputSink sink{std::cout, flush_settings};
+      std::ostream out{&sink};
+      summarizer.follow(
+          std::cin, out, follow_settings,
+          [&](const model_wrapper::GenerationStats &generation) {
+            out.flush();
+            if (is_stats_enabled) {
+              model_wrapper::SummaryStats stats{};
+              stats.generation = generation;
+              write_stats(stats_path, stats, run_timings());
+            }
+          });
+      sink.close();
+      return 0;
+    }
+
+    if (!is_batch_mode) {
+      // Decoding hands the tokens to the sink and never waits for stdout
+      model_wrapper::OutputSink sink{std::cout, flush_settings};
+      // With a cache the summary is kept while it is written
+      model_wrapper::CaptureBuffer capture{&sink};
+      std::ostream out{summary_key.empty()
+                           ? static_cast<std::streambuf *>(&sink)
+                           : &capture};
+      const auto stats = is_stream_mode
+                             ? summarizer.summarize_stream(std::cin, out)
+                             : summarizer.summarize(document, out,
+                                                    session_path);
+      sink.close();
+      if (stats.dropped_tokens > 0U) {
+        std::cerr << "Left out " << stats.dropped_tokens << " of "
+                  << stats.document_tokens << " tokens ("
+                  << stats.dropped_bytes << " bytes) to fit the token budget"
+                  << std::endl;
+      }
+      if (!summary_key.empty()) {
+        summary_cache->store(summary_key, capture.get_text());
+      }
+      if (is_stats_enabled) {
+        write_stats(stats_path, stats, run_timings());
+      }
+      return 0;
+    }
+
+    const auto output_path = parser.get_option<std::string>("output");
+    std::ofstream output_file;
+    if (!output_path.empty()) {
+      output_file.open(output_path);
+      if (!output_file) {
+        throw std::runtime_error{"Cannot open output file: " + output_path};
+      }
+    }
+
+    const auto number_of_sequences = static_cast<std::size_t>(
+        std::max(1, parser.get_option<int>("sequences")));
+    model_wrapper::OutputSink sink{
+        output_path.empty() ? std::cout : output_file, flush_settings};
+    std::ostream out{&sink};
+    model_wrapper::SummaryStats total_stats{};
+    const auto number_of_failed = batch_runner.run(
+        model, summarizer, out, number_of_sequences, &total_stats);
+    sink.close();
+
+    if (is_stats_enabled) {
+      write_stats(stats_path, total_stats, run_timings());
+    }
+    if (number_of_failed > 0U) {
+      std::cerr << number_of_failed << " of "
+                << batch_runner.get_inputs().size()
+                << " inputs failed to summarize" << std::endl;
+      return 1;
+    }
 
   } catch (const std::exception &e) {
     std::cerr << "Failed: " << e.what() << std::endl;
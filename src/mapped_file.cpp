@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: mapped_file.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace model_wrapper {
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+  const int file_descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file_descriptor < 0) {
+    throw std::runtime_error{"Cannot open file: " + path.string()};
+  }
+
+  struct stat file_status{};
+  if (fstat(file_descriptor, &file_status) != 0) {
+    close(file_descriptor);
+    throw std::runtime_error{"Cannot read file size: " + path.string()};
+  }
+  m_size = static_cast<std::size_t>(file_status.st_size);
+
+  // Empty files cannot be mapped, they are an empty view
+  if (m_size > 0U) {
+    m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  }
+  close(file_descriptor);
+
+  if (m_data == MAP_FAILED) {
+    m_data = nullptr;
+    throw std::runtime_error{"Cannot map file: " + path.string()};
+  }
+
+  // The tokenizer reads the content front to back once
+  if (m_data != nullptr) {
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+  }
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0U)) {}
+
+std::string_view MappedFile::get_view() const {
+  if (m_data == nullptr) {
+    return {};
+  }
+  return {static_cast<const char *>(m_data), m_size};
+}
+} // namespace model_wrapper
@@ -10,31 +10,227 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "model.h"
+#include "cpu_placement.h"
+#include "hash.h"
+#include "startup.h"
 #include "llama-cpp.h"
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
 #include <ostream>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 namespace model_wrapper {
 
+namespace {
+/**
+ * \brief Owns a batch from llama_batch_init
+ */
+struct BatchGuard {
+  llama_batch batch;
+
+  explicit BatchGuard(const int32_t capacity)
+      : batch(llama_batch_init(capacity, 0, 1)) {}
+  ~BatchGuard() { llama_batch_free(batch); }
+  BatchGuard(const BatchGuard &) = delete;
+  BatchGuard &operator=(const BatchGuard &) = delete;
+};
+
+/**
+ * \brief Texts from this size on are tokenized on several threads
+ */
+constexpr std::size_t PARALLEL_TOKENIZE_SIZE{4U * 1024U * 1024U};
+
+/**
+ * \brief Smallest text tokenized by one thread of the parallel tokenizer
+ */
+constexpr std::size_t MIN_SHARD_SIZE{512U * 1024U};
+
+/**
+ * \brief Shards per thread of the parallel tokenizer
+ */
+constexpr std::size_t SHARDS_PER_THREAD{4U};
+
+/**
+ * \brief Types llama.cpp can keep the K and V caches in
+ */
+constexpr std::array CACHE_TYPES{GGML_TYPE_F32,  GGML_TYPE_F16,  GGML_TYPE_BF16,
+                                 GGML_TYPE_Q8_0, GGML_TYPE_Q5_1, GGML_TYPE_Q5_0,
+                                 GGML_TYPE_Q4_1, GGML_TYPE_Q4_0};
+
+/**
+ * \brief llama.cpp pads the K and V caches to a multiple of this many cells
+ */
+constexpr std::size_t KV_CACHE_PADDING{256U};
+
+/**
+ * \brief Activations of a token in the compute buffers, in multiples of the
+ * embedding size
+ * \details The feed-forward layers are about four times wider than the
+ * embedding and their gate and up projections are alive at the same time
+ * as the attention inputs and the residual stream.
+ */
+constexpr std::size_t ACTIVATION_WIDTH{12U};
+
+/**
+ * \brief Tell if the cache type is quantized, llama.cpp only reads a
+ * quantized V cache with flash attention
+ */
+bool is_quantized(const ggml_type type) {
+  return type != GGML_TYPE_F32 && type != GGML_TYPE_F16 &&
+         type != GGML_TYPE_BF16;
+}
+
+/**
+ * \brief Trained context sizes the idle contexts of a pool may add up to by
+ * default
+ */
+constexpr std::size_t IDLE_CONTEXTS_PER_POOL{2U};
+
+/**
+ * \brief Context size of the warmup decode, only one token is evaluated
+ */
+constexpr std::size_t WARMUP_CONTEXT_SIZE{256U};
+
+/**
+ * \brief Tell if the character is printable ASCII other than a space, a
+ * line can start with it without being merged with the line break before
+ */
+bool is_visible(const char character) {
+  return character > ' ' && character < '\x7f';
+}
+
+void add_to_batch(llama_batch &batch, const llama_token token,
+                  const llama_pos position, const llama_seq_id sequence_id,
+                  const bool is_logits_needed) {
+  batch.token[batch.n_tokens] = token;
+  batch.pos[batch.n_tokens] = position;
+  batch.n_seq_id[batch.n_tokens] = 1;
+  batch.seq_id[batch.n_tokens][0] = sequence_id;
+  batch.logits[batch.n_tokens] = is_logits_needed;
+  ++batch.n_tokens;
+}
+
+/**
+ * \brief State of one sequence in batched generation
+ */
+struct Sequence {
+  std::optional<SequenceRequest> request;
+  std::vector<llama_token> tokens;
+  std::size_t number_of_evaluated{0U};
+  int32_t logits_index{-1};
+  std::size_t capacity{0U};
+  llama_sampler_ptr sampler{nullptr};
+  GenerationStats stats{};
+  std::chrono::steady_clock::time_point start_time{};
+  std::chrono::steady_clock::time_point previous_token_time{};
+};
+
+/**
+ * \brief A tokenized request waiting for a free sequence in batched
+ * generation
+ */
+struct PendingSequence {
+  SequenceRequest request;
+  std::vector<llama_token> tokens;
+  std::chrono::steady_clock::time_point tokenize_start_time{};
+};
+
+double elapsed_ms(const std::chrono::steady_clock::time_point start_time) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start_time)
+      .count();
+}
+} // namespace
+
+GenerationStats &GenerationStats::operator+=(const GenerationStats &other) {
+  prompt_tokens += other.prompt_tokens;
+  cached_tokens += other.cached_tokens;
+  generated_tokens += other.generated_tokens;
+  tokenize_ms += other.tokenize_ms;
+  context_ms += other.context_ms;
+  prefill_ms += other.prefill_ms;
+  decode_ms += other.decode_ms;
+  output_ms += other.output_ms;
+  llama_prompt_eval_ms += other.llama_prompt_eval_ms;
+  llama_prompt_eval_tokens += other.llama_prompt_eval_tokens;
+  llama_eval_ms += other.llama_eval_ms;
+  llama_eval_tokens += other.llama_eval_tokens;
+  context_size = std::max(context_size, other.context_size);
+  kv_bytes = std::max(kv_bytes, other.kv_bytes);
+  time_to_first_token_ms += other.time_to_first_token_ms;
+  token_latencies_ms.insert(token_latencies_ms.end(),
+                            other.token_latencies_ms.begin(),
+                            other.token_latencies_ms.end());
+  target_decodes += other.target_decodes;
+  draft_tokens += other.draft_tokens;
+  accepted_draft_tokens += other.accepted_draft_tokens;
+  return *this;
+}
+
+std::string SamplerSettings::describe() const {
+  return "top_k=" + std::to_string(top_k) +
+         " min_p=" + std::to_string(min_p) +
+         " min_keep=" + std::to_string(min_keep) +
+         " penalty_last_n=" + std::to_string(penalty_last_n) +
+         " repeat_penalty=" + std::to_string(repeat_penalty) +
+         " frequency_penalty=" + std::to_string(frequency_penalty) +
+         " presence_penalty=" + std::to_string(presence_penalty) +
+         " seed=" + std::to_string(seed);
+}
+
+ggml_type parse_cache_type(const std::string_view name) {
+  for (const auto type : CACHE_TYPES) {
+    if (name == ggml_type_name(type)) {
+      return type;
+    }
+  }
+  throw std::invalid_argument{"Unknown cache type: " + std::string{name}};
+}
+
+llama_flash_attn_type parse_flash_attention(const std::string_view name) {
+  if (name == "on") {
+    return LLAMA_FLASH_ATTN_TYPE_ENABLED;
+  }
+  if (name == "off") {
+    return LLAMA_FLASH_ATTN_TYPE_DISABLED;
+  }
+  if (name == "auto") {
+    return LLAMA_FLASH_ATTN_TYPE_AUTO;
+  }
+  throw std::invalid_argument{"Unknown flash attention setting: " +
+                              std::string{name}};
+}
+
 Model::Model(const std::string_view model_path, const float temperature,
              const int32_t number_of_gpu_layers,
-             const std::size_t prediction_length)
-    : m_temperature(temperature), m_prediction_length(prediction_length) {
+             const std::size_t prediction_length,
+             const LoadSettings &load_settings)
+    : m_model_path(model_path), m_temperature(temperature),
+      m_prediction_length(prediction_length) {
+  // Only the first model of the process loads the backends, it is not part
+  // of the load time
+  initialize_backend();
+
+  const auto start_time = std::chrono::steady_clock::now();
   auto model_params = llama_model_default_params();
   model_params.n_gpu_layers = number_of_gpu_layers;
-
-  llama_log_set(
-      [](auto log_level, const char *log_message, auto /* user_data */) {
-        if (log_level >= GGML_LOG_LEVEL_ERROR) {
-          std::cerr << log_message;
-        }
-      },
-      nullptr);
-
-  ggml_backend_load_all();
+  model_params.use_mmap = load_settings.is_memory_mapped;
+  model_params.use_mlock = load_settings.is_memory_locked;
+  model_params.vocab_only = load_settings.is_vocab_only;
 
   m_model = llama_model_ptr{
       llama_model_load_from_file(model_path.data(), model_params)};
@@ -43,33 +239,279 @@ Model::Model(const std::string_view model_path, const float temperature,
     throw std::runtime_error{"Failed to load model!"};
   }
   m_vocab = llama_model_get_vocab(m_model.get());
+  m_is_split_safe = llama_vocab_type(m_vocab) == LLAMA_VOCAB_TYPE_BPE;
 
   initialize_sampler();
+  reset_context_pool();
+  m_load_ms = elapsed_ms(start_time);
+
+  // Generated tokens are looked up instead of rendered one by one
+  m_piece_table = std::make_unique<PieceTable>(m_vocab);
 }
 
-std::vector<llama_token> Model::tokenize_prompt(const std::string &prompt) {
+std::vector<llama_token>
+Model::tokenize_prompt(const std::string_view prompt) {
   const bool is_adding_special_tokens{true};
   const bool is_parsing_special_tokens{true};
 
-  // llama_tokenize with nullptr returns negative number of tokens if it would
-  // have succeeded
-  const auto number_of_tokens =
-      -llama_tokenize(m_vocab, prompt.data(), prompt.size(), nullptr, 0,
-                      is_adding_special_tokens, is_parsing_special_tokens);
+  return tokenize(prompt, is_adding_special_tokens, is_parsing_special_tokens);
+}
+
+std::vector<llama_token>
+Model::tokenize(const std::string_view text,
+                const bool is_adding_special_tokens,
+                const bool is_parsing_special_tokens) const {
+  std::vector<llama_token> tokens;
+  tokenize_into(text, is_adding_special_tokens, is_parsing_special_tokens,
+                tokens);
+
+  // The buffer is sized by estimate_tokens, usually twice the tokens, which
+  // a large document would otherwise keep for its whole lifetime
+  if (tokens.capacity() - tokens.size() > tokens.size() / 4U) {
+    tokens.shrink_to_fit();
+  }
+  return tokens;
+}
+
+void Model::tokenize_into(const std::string_view text,
+                          const bool is_adding_special_tokens,
+                          const bool is_parsing_special_tokens,
+                          std::vector<llama_token> &tokens) const {
+  const auto offset = tokens.size();
+  tokens.resize(offset + estimate_tokens(text.size()));
+
+  // llama_tokenize returns negative number of tokens if the buffer is too
+  // small, so a second pass is only needed if the estimate was wrong
+  auto number_of_tokens = llama_tokenize(
+      m_vocab, text.data(), text.size(), tokens.data() + offset,
+      tokens.size() - offset, is_adding_special_tokens,
+      is_parsing_special_tokens);
+
+  if (number_of_tokens < 0) {
+    tokens.resize(offset - number_of_tokens);
+    number_of_tokens = llama_tokenize(
+        m_vocab, text.data(), text.size(), tokens.data() + offset,
+        tokens.size() - offset, is_adding_special_tokens,
+        is_parsing_special_tokens);
+  }
+
+  if (number_of_tokens < 0) {
+    tokens.resize(offset);
+    throw std::runtime_error{"Failed to tokenize text!"};
+  }
+
+  tokens.resize(offset + number_of_tokens);
+}
+
+std::size_t Model::estimate_tokens(const std::size_t text_size) {
+  // Room for the special tokens of short texts as well
+  return text_size / 2U + 16U;
+}
+
+std::size_t Model::find_token_boundary(const std::string_view text) {
+  for (auto position = text.size(); position >= 2U; --position) {
+    if (text[position - 2U] == '\n' && is_visible(text[position - 1U])) {
+      return position - 1U;
+    }
+  }
+  return 0U;
+}
 
-  std::vector<llama_token> tokens(number_of_tokens);
-  const bool is_tokenized =
-      (llama_tokenize(m_vocab, prompt.data(), prompt.size(), tokens.data(),
-                      tokens.size(), is_adding_special_tokens,
-                      is_parsing_special_tokens) >= 0);
+std::vector<llama_token>
+Model::tokenize_text(const std::string_view text) const {
+  // Threads only pay off for texts that take milliseconds to tokenize
+  return tokenize_text(text, text.size() >= PARALLEL_TOKENIZE_SIZE
+                                 ? get_available_cpus()
+                                 : 1U);
+}
 
-  if (!is_tokenized) {
-    throw std::runtime_error{"Failed to tokenize prompt!"};
+std::vector<llama_token>
+Model::tokenize_text(const std::string_view text,
+                     const std::size_t number_of_threads) const {
+  const bool is_adding_special_tokens{false};
+  const bool is_parsing_special_tokens{false};
+
+  // Several shards per thread even out shards that tokenize slower
+  std::vector<std::string_view> shards;
+  const auto number_of_shards = std::min(
+      number_of_threads * SHARDS_PER_THREAD, text.size() / MIN_SHARD_SIZE);
+  if (m_is_split_safe && number_of_threads > 1U && number_of_shards > 1U) {
+    // Every shard ends at the first token boundary after its size
+    const auto shard_size = text.size() / number_of_shards;
+    std::size_t shard_start{0U};
+    auto line_end = text.find('\n', shard_start + shard_size);
+    while (line_end != std::string_view::npos && line_end + 1U < text.size()) {
+      if (!is_visible(text[line_end + 1U])) {
+        line_end = text.find('\n', line_end + 1U);
+        continue;
+      }
+      shards.push_back(text.substr(shard_start, line_end + 1U - shard_start));
+      shard_start = line_end + 1U;
+      line_end = text.find('\n', shard_start + shard_size);
+    }
+    shards.push_back(text.substr(shard_start));
   }
 
+  if (shards.size() <= 1U) {
+    return tokenize(text, is_adding_special_tokens, is_parsing_special_tokens);
+  }
+
+  std::vector<std::vector<llama_token>> shard_tokens(shards.size());
+  std::atomic<std::size_t> next_shard{0U};
+  std::exception_ptr failure{nullptr};
+  std::mutex failure_mutex;
+  const auto worker = [&]() {
+    for (auto index = next_shard++; index < shards.size();
+         index = next_shard++) {
+      try {
+        tokenize_into(shards[index], is_adding_special_tokens,
+                      is_parsing_special_tokens, shard_tokens[index]);
+      } catch (...) {
+        const std::lock_guard lock{failure_mutex};
+        if (!failure) {
+          failure = std::current_exception();
+        }
+        next_shard = shards.size();
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t i = 1U; i < std::min(number_of_threads, shards.size());
+         ++i) {
+      workers.emplace_back(worker);
+    }
+    worker();
+  }
+
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+
+  std::size_t number_of_tokens{0U};
+  for (const auto &tokens : shard_tokens) {
+    number_of_tokens += tokens.size();
+  }
+  std::vector<llama_token> tokens;
+  tokens.reserve(number_of_tokens);
+  for (const auto &shard : shard_tokens) {
+    tokens.insert(tokens.end(), shard.begin(), shard.end());
+  }
   return tokens;
 }
 
+void Model::tokenize_text_into(const std::string_view text,
+                               std::vector<llama_token> &tokens) const {
+  const bool is_adding_special_tokens{false};
+  const bool is_parsing_special_tokens{false};
+
+  tokenize_into(text, is_adding_special_tokens, is_parsing_special_tokens,
+                tokens);
+}
+
+std::vector<llama_token>
+Model::tokenize_template(const std::string_view text,
+                         const bool is_prompt_start) const {
+  const bool is_parsing_special_tokens{true};
+
+  return tokenize(text, is_prompt_start, is_parsing_special_tokens);
+}
+
+std::string Model::detokenize(const std::span<const llama_token> tokens) const {
+  const bool is_removing_special_tokens{false};
+  const bool is_unparsing_special_tokens{false};
+
+  // Same as llama_tokenize, a negative result is the required buffer size
+  std::string text(tokens.size() * 4, '\0');
+  auto text_size = llama_detokenize(
+      m_vocab, tokens.data(), tokens.size(), text.data(), text.size(),
+      is_removing_special_tokens, is_unparsing_special_tokens);
+
+  if (text_size < 0) {
+    text.resize(-text_size);
+    text_size = llama_detokenize(m_vocab, tokens.data(), tokens.size(),
+                                 text.data(), text.size(),
+                                 is_removing_special_tokens,
+                                 is_unparsing_special_tokens);
+  }
+
+  if (text_size < 0) {
+    throw std::runtime_error{"Failed to detokenize text!"};
+  }
+
+  text.resize(text_size);
+  return text;
+}
+
+std::size_t Model::get_trained_context_size() const {
+  return llama_model_n_ctx_train(m_model.get());
+}
+
+const PieceTable &Model::get_piece_table() const { return *m_piece_table; }
+
+double Model::get_load_ms() const { return m_load_ms; }
+
+std::size_t Model::get_prediction_length() const {
+  return m_prediction_length;
+}
+
+void Model::set_context_settings(const ContextSettings &settings) {
+  check_context_pool_unused();
+  if (settings.n_batch == 0U || settings.n_ubatch == 0U) {
+    throw std::invalid_argument{"Batch sizes must be positive!"};
+  }
+  if (is_quantized(settings.type_v) &&
+      settings.flash_attention == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+    throw std::invalid_argument{"Quantized V cache needs flash attention!"};
+  }
+  m_context_settings = settings;
+  reset_context_pool();
+}
+
+const ContextSettings &Model::get_context_settings() const {
+  return m_context_settings;
+}
+
+MemoryEstimate
+Model::estimate_memory(const std::size_t number_of_tokens) const {
+  const auto *model = m_model.get();
+  const std::size_t n_layer = llama_model_n_layer(model);
+  const std::size_t n_embd = llama_model_n_embd(model);
+  const std::size_t n_head = std::max(1, llama_model_n_head(model));
+  const std::size_t n_head_kv = llama_model_n_head_kv(model);
+  const std::size_t n_vocab = llama_vocab_n_tokens(m_vocab);
+
+  MemoryEstimate estimate{};
+  estimate.context_size = m_context_pool->get_capacity(number_of_tokens);
+  estimate.number_of_contexts = 1U;
+  estimate.weights_bytes = llama_model_size(model);
+
+  // Grouped-query attention caches fewer heads than it queries with
+  const auto kv_width = n_embd / n_head * n_head_kv;
+  const auto kv_cells = (estimate.context_size + KV_CACHE_PADDING - 1U) /
+                        KV_CACHE_PADDING * KV_CACHE_PADDING;
+  estimate.kv_bytes =
+      n_layer * kv_cells *
+      (ggml_row_size(m_context_settings.type_k, kv_width) +
+       ggml_row_size(m_context_settings.type_v, kv_width));
+
+  const auto n_batch = std::min<std::size_t>(m_context_settings.n_batch,
+                                             estimate.context_size);
+  const auto n_ubatch =
+      std::min<std::size_t>(m_context_settings.n_ubatch, n_batch);
+  estimate.compute_bytes =
+      n_ubatch * (n_vocab + ACTIVATION_WIDTH * n_embd) * sizeof(float);
+  if (m_context_settings.flash_attention != LLAMA_FLASH_ATTN_TYPE_ENABLED &&
+      !is_quantized(m_context_settings.type_v)) {
+    // The scores of every head and their softmax are alive at once
+    estimate.compute_bytes +=
+        2U * n_head * n_ubatch * kv_cells * sizeof(float);
+  }
+
+  return estimate;
+}
+
 void Model::initialize_sampler() {
   if (m_sampler) {
     return;
@@ -77,38 +519,361 @@ void Model::initialize_sampler() {
 
   m_sampler = llama_sampler_ptr{
       llama_sampler_chain_init(llama_sampler_chain_default_params())};
-  llama_sampler_chain_add(m_sampler.get(), llama_sampler_init_top_k(35));
-  llama_sampler_chain_add(m_sampler.get(), llama_sampler_init_min_p(0.3f, 2));
+  llama_sampler_chain_add(m_sampler.get(),
+                          llama_sampler_init_top_k(m_sampler_settings.top_k));
+  llama_sampler_chain_add(
+      m_sampler.get(), llama_sampler_init_min_p(m_sampler_settings.min_p,
+                                                m_sampler_settings.min_keep));
   llama_sampler_chain_add(m_sampler.get(),
                           llama_sampler_init_temp(m_temperature));
   llama_sampler_chain_add(m_sampler.get(),
-                          llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+                          llama_sampler_init_dist(m_sampler_settings.seed));
 
   // Reduce repetition and overused tokens
-  int32_t last_n_tokens_to_penalize = 128;
-  float repeat_penalty = 1.5f;
-  float frequency_penalty = 0.7f;
-  float presence_penalty = 0.7f;
-
   llama_sampler_chain_add(
       m_sampler.get(),
-      llama_sampler_init_penalties(last_n_tokens_to_penalize, repeat_penalty,
-                                   frequency_penalty, presence_penalty));
+      llama_sampler_init_penalties(m_sampler_settings.penalty_last_n,
+                                   m_sampler_settings.repeat_penalty,
+                                   m_sampler_settings.frequency_penalty,
+                                   m_sampler_settings.presence_penalty));
 }
 
-llama_context_ptr Model::create_context(const std::size_t number_of_tokens) {
-  if (!m_model) {
+llama_context_ptr Model::create_context(llama_model *model,
+                                        const std::size_t context_size) {
+  if (!model) {
     throw std::runtime_error{
         "Context cannot be created: Model is not initialized!"};
   }
 
-  const std::size_t context_size = number_of_tokens + m_prediction_length;
   auto context_params = llama_context_default_params();
   context_params.n_ctx = context_size;
-  context_params.n_batch = number_of_tokens;
+  apply_context_settings(context_params);
+
+  return llama_context_ptr{llama_init_from_model(model, context_params)};
+}
+
+void Model::check_context_pool_unused() const {
+  if ((m_context_pool && m_context_pool->is_used()) ||
+      (m_draft_pool && m_draft_pool->is_used())) {
+    throw std::runtime_error{
+        "Context settings cannot change after the first generation!"};
+  }
+}
+
+void Model::reset_context_pool() {
+  check_context_pool_unused();
+
+  const auto get_max_idle_tokens = [this](const std::size_t context_size) {
+    return m_context_settings.max_idle_tokens > 0U
+               ? m_context_settings.max_idle_tokens
+               : IDLE_CONTEXTS_PER_POOL * context_size;
+  };
+
+  m_context_pool = std::make_unique<ContextPool>(
+      [this](const std::size_t context_size) {
+        return create_context(m_model.get(), context_size);
+      },
+      m_sampler.get(), m_context_settings.max_idle_contexts,
+      get_max_idle_tokens(get_trained_context_size()),
+      get_trained_context_size());
+
+  if (m_draft_model) {
+    m_draft_pool = std::make_unique<ContextPool>(
+        [this](const std::size_t context_size) {
+          return create_context(m_draft_model.get(), context_size);
+        },
+        m_draft_sampler.get(), m_context_settings.max_idle_contexts,
+        get_max_idle_tokens(llama_model_n_ctx_train(m_draft_model.get())),
+        llama_model_n_ctx_train(m_draft_model.get()));
+  }
+}
+
+ThreadTimings Model::measure_threads(std::vector<llama_token> prompt,
+                                    const std::size_t number_of_decoded,
+                                    const std::uint32_t number_of_threads) {
+  if (prompt.empty()) {
+    throw std::runtime_error{"Cannot measure threads: Prompt is empty!"};
+  }
+
+  const auto lease =
+      m_context_pool->acquire(prompt.size() + number_of_decoded);
+  const auto context = lease.get_context();
+
+  // Pooled contexts keep their thread counts, they are restored afterwards
+  const auto previous_threads = llama_n_threads(context);
+  const auto previous_threads_batch = llama_n_threads_batch(context);
+  llama_set_n_threads(context, static_cast<int32_t>(number_of_threads),
+                      static_cast<int32_t>(number_of_threads));
+
+  ThreadTimings timings{};
+  try {
+    auto start_time = std::chrono::steady_clock::now();
+    decode_tokens(context, prompt);
+    timings.prefill_ms = elapsed_ms(start_time);
+
+    start_time = std::chrono::steady_clock::now();
+    auto token = prompt.back();
+    for (std::size_t i = 0U; i < number_of_decoded; ++i) {
+      if (llama_decode(context, llama_batch_get_one(&token, 1)) != 0) {
+        throw std::runtime_error{
+            "Cannot measure threads: Failed to decode!"};
+      }
+    }
+    timings.decode_ms = elapsed_ms(start_time);
+  } catch (...) {
+    llama_set_n_threads(context, previous_threads, previous_threads_batch);
+    throw;
+  }
+
+  llama_set_n_threads(context, previous_threads, previous_threads_batch);
+  return timings;
+}
+
+double Model::warmup() {
+  const auto start_time = std::chrono::steady_clock::now();
+
+  auto token = llama_vocab_bos(m_vocab);
+  if (token == LLAMA_TOKEN_NULL) {
+    token = llama_vocab_eos(m_vocab);
+  }
+
+  for (auto *model : {m_model.get(), m_draft_model.get()}) {
+    if (!model) {
+      continue;
+    }
+
+    // The context is not pooled, its size is unlikely to be asked for
+    const auto context = create_context(model, WARMUP_CONTEXT_SIZE);
+    if (!context) {
+      throw std::runtime_error{"Cannot warm up: Failed to create context!"};
+    }
+    if (llama_decode(context.get(), llama_batch_get_one(&token, 1)) != 0) {
+      throw std::runtime_error{"Cannot warm up: Failed to decode!"};
+    }
+    llama_synchronize(context.get());
+  }
+
+  return elapsed_ms(start_time);
+}
+
+void Model::enable_draft_model(const std::string_view model_path,
+                               const int32_t number_of_gpu_layers,
+                               const SpeculativeSettings &settings,
+                               const LoadSettings &load_settings) {
+  if (settings.initial_draft_tokens == 0U ||
+      settings.max_draft_tokens == 0U) {
+    throw std::invalid_argument{"Numbers of draft tokens must be positive!"};
+  }
+  check_context_pool_unused();
+
+  auto model_params = llama_model_default_params();
+  model_params.n_gpu_layers = number_of_gpu_layers;
+  model_params.use_mmap = load_settings.is_memory_mapped;
+  model_params.use_mlock = load_settings.is_memory_locked;
+  llama_model_ptr draft_model{llama_model_load_from_file(
+      std::string{model_path}.c_str(), model_params)};
+
+  if (!draft_model) {
+    throw std::runtime_error{"Failed to load draft model!"};
+  }
+
+  // Proposals are token ids of the model, so both must number the tokens
+  // the same way
+  const auto draft_vocab = llama_model_get_vocab(draft_model.get());
+  const bool is_same_vocab =
+      llama_vocab_n_tokens(draft_vocab) == llama_vocab_n_tokens(m_vocab) &&
+      llama_vocab_bos(draft_vocab) == llama_vocab_bos(m_vocab) &&
+      llama_vocab_eos(draft_vocab) == llama_vocab_eos(m_vocab);
+  if (!is_same_vocab) {
+    throw std::runtime_error{"Draft model does not share the vocabulary!"};
+  }
+
+  // The old pool refers to the old draft model
+  m_draft_pool.reset();
+  m_draft_model = std::move(draft_model);
+  if (!m_draft_sampler) {
+    m_draft_sampler = llama_sampler_ptr{llama_sampler_init_greedy()};
+  }
+  m_speculative_settings = settings;
+  m_speculative_settings.initial_draft_tokens = std::min(
+      settings.initial_draft_tokens, settings.max_draft_tokens);
+  reset_context_pool();
+}
+
+void Model::enable_prompt_lookup(const SpeculativeSettings &settings) {
+  if (settings.initial_draft_tokens == 0U ||
+      settings.max_draft_tokens == 0U) {
+    throw std::invalid_argument{"Numbers of draft tokens must be positive!"};
+  }
+  if (settings.min_ngram_size == 0U ||
+      settings.min_ngram_size > settings.max_ngram_size) {
+    throw std::invalid_argument{"Invalid n-gram sizes for prompt lookup!"};
+  }
+
+  m_speculative_settings = settings;
+  m_speculative_settings.initial_draft_tokens = std::min(
+      settings.initial_draft_tokens, settings.max_draft_tokens);
+  m_is_prompt_lookup_enabled = true;
+}
+
+std::unique_ptr<DraftSource>
+Model::create_draft_source(const std::size_t context_size,
+                           const std::span<const llama_token> prompt) {
+  if (m_draft_pool) {
+    return std::make_unique<DraftModelSource>(
+        m_draft_pool->acquire(context_size));
+  }
+  if (m_is_prompt_lookup_enabled) {
+    return std::make_unique<PromptLookupSource>(prompt,
+                                                m_speculative_settings);
+  }
+  return nullptr;
+}
+
+void Model::apply_context_settings(
+    llama_context_params &context_params) const {
+  // A batch larger than the context would only reserve unused buffers
+  context_params.n_batch =
+      std::min<std::uint32_t>(m_context_settings.n_batch, context_params.n_ctx);
+  context_params.n_ubatch =
+      std::min(m_context_settings.n_ubatch, context_params.n_batch);
+
+  if (m_context_settings.n_threads > 0U) {
+    context_params.n_threads =
+        static_cast<int32_t>(m_context_settings.n_threads);
+  }
+  if (m_context_settings.n_threads_batch > 0U) {
+    context_params.n_threads_batch =
+        static_cast<int32_t>(m_context_settings.n_threads_batch);
+  }
 
-  return llama_context_ptr{
-      llama_init_from_model(m_model.get(), context_params)};
+  context_params.type_k = m_context_settings.type_k;
+  context_params.type_v = m_context_settings.type_v;
+  // Auto could pick no flash attention on some devices, which fails the
+  // context with a quantized V cache
+  context_params.flash_attn_type =
+      is_quantized(m_context_settings.type_v)
+          ? LLAMA_FLASH_ATTN_TYPE_ENABLED
+          : m_context_settings.flash_attention;
+}
+
+void Model::decode_tokens(llama_context *context,
+                          const std::span<llama_token> tokens) const {
+  const std::size_t batch_size = llama_n_batch(context);
+
+  for (std::size_t position = 0U; position < tokens.size();
+       position += batch_size) {
+    const auto batch = llama_batch_get_one(
+        tokens.data() + position,
+        std::min(batch_size, tokens.size() - position));
+    if (llama_decode(context, batch) != 0) {
+      throw std::runtime_error{"Cannot generate response: Failed to decode!"};
+    }
+  }
+}
+
+std::size_t Model::restore_prefix(llama_context *context,
+                                  std::vector<llama_token> &tokens) {
+  if (!m_prefix_cache) {
+    return 0U;
+  }
+
+  const auto &prefix_tokens = m_prefix_cache->get_prefix_tokens();
+  const bool is_prefixed =
+      tokens.size() > prefix_tokens.size() &&
+      std::equal(prefix_tokens.begin(), prefix_tokens.end(), tokens.begin());
+  if (!is_prefixed) {
+    return 0U;
+  }
+
+  if (!m_prefix_cache->restore(context)) {
+    decode_tokens(context, {tokens.data(), prefix_tokens.size()});
+    m_prefix_cache->store(context);
+  }
+
+  return prefix_tokens.size();
+}
+
+std::size_t
+Model::restore_session(llama_context *context,
+                       const std::filesystem::path &session_path,
+                       const std::vector<llama_token> &tokens) const {
+  std::error_code error;
+  if (tokens.empty() || !std::filesystem::exists(session_path, error)) {
+    return 0U;
+  }
+
+  // A session longer than the context cannot be loaded into it
+  std::vector<llama_token> stored_tokens(llama_n_ctx(context));
+  std::size_t number_of_stored_tokens{0U};
+  const auto memory = llama_get_memory(context);
+  if (llama_state_seq_load_file(context, session_path.c_str(), 0,
+                                stored_tokens.data(), stored_tokens.size(),
+                                &number_of_stored_tokens) == 0) {
+    llama_memory_seq_rm(memory, 0, -1, -1);
+    return 0U;
+  }
+  stored_tokens.resize(number_of_stored_tokens);
+
+  const auto mismatch =
+      std::mismatch(stored_tokens.begin(), stored_tokens.end(),
+                    tokens.begin(), tokens.end());
+  // The last prompt token is evaluated again for its logits
+  const auto number_of_common = std::min<std::size_t>(
+      std::distance(stored_tokens.begin(), mismatch.first),
+      tokens.size() - 1U);
+
+  // Not every memory can drop a tail, e.g. recurrent ones
+  if (!llama_memory_seq_rm(memory, 0, number_of_common, -1)) {
+    llama_memory_seq_rm(memory, 0, -1, -1);
+    return 0U;
+  }
+  return number_of_common;
+}
+
+void Model::save_session(llama_context *context,
+                         const std::filesystem::path &session_path,
+                         const std::span<const llama_token> prompt) const {
+  if (!llama_memory_seq_rm(llama_get_memory(context), 0, prompt.size(),
+                           -1)) {
+    return;
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(session_path.parent_path(), error);
+
+  // Another run of the same session never reads a partial file
+  auto temporary_path = session_path;
+  temporary_path += ".tmp" + std::to_string(getpid());
+  const bool is_saved =
+      llama_state_seq_save_file(context, temporary_path.c_str(), 0,
+                                prompt.data(), prompt.size()) != 0;
+
+  if (is_saved) {
+    std::filesystem::rename(temporary_path, session_path, error);
+  }
+  if (!is_saved || error) {
+    std::filesystem::remove(temporary_path, error);
+  }
+}
+
+void Model::enable_prefix_cache(const std::string &directory,
+                                const std::string &prefix) {
+  // The saved state is laid out by the cache types and flash attention,
+  // runs with other settings cannot restore it
+  auto context_params = llama_context_default_params();
+  apply_context_settings(context_params);
+  const auto layout = std::to_string(context_params.type_k) + ":" +
+                      std::to_string(context_params.type_v) + ":" +
+                      std::to_string(context_params.flash_attn_type);
+
+  m_prefix_cache = std::make_unique<PrefixCache>(
+      directory, fingerprint_file(m_model_path), hash_bytes(layout), prefix,
+      tokenize_prompt(prefix));
+}
+
+std::string_view Model::token_to_piece(const llama_token token) const {
+  return m_piece_table->get_piece(token);
 }
 
 std::string
@@ -132,62 +897,673 @@ Model::get_formatted_prompt(const std::vector<llama_chat_message> &messages) {
   }
 
   if (formatted_prompt_size < 0) {
-    std::runtime_error{"Failed to apply chat template!"};
+    throw std::runtime_error{"Failed to apply chat template!"};
   }
 
   return formatted_prompt;
 }
 
-void Model::generate_response(const std::string &prompt, std::ostream &out) {
+GenerationStats Model::generate_response(const std::string_view prompt,
+                                         std::ostream &out) {
+  const auto start_time = std::chrono::steady_clock::now();
+  GenerationStats stats{};
+
   auto tokens = tokenize_prompt(prompt);
-  const auto context = create_context(tokens.size());
-  if (!context) {
-    throw std::runtime_error{
-        "Cannot generate response: Failed to initialize context!"};
+  stats.tokenize_ms = elapsed_ms(start_time);
+
+  return respond_to_tokens(tokens, start_time, std::move(stats), out);
+}
+
+GenerationStats Model::generate_response(std::vector<llama_token> tokens,
+                                         std::ostream &out) {
+  return respond_to_tokens(tokens, std::chrono::steady_clock::now(),
+                           GenerationStats{}, out);
+}
+
+GenerationStats
+Model::generate_response(std::vector<llama_token> tokens,
+                         const std::filesystem::path &session_path,
+                         std::ostream &out) {
+  return respond_to_tokens(tokens, std::chrono::steady_clock::now(),
+                           GenerationStats{}, out, session_path);
+}
+
+GenerationStats
+Model::respond_to_tokens(std::vector<llama_token> &tokens,
+                         const std::chrono::steady_clock::time_point start_time,
+                         GenerationStats stats, std::ostream &out,
+                         const std::filesystem::path &session_path) {
+  // The pooled context comes with its own sampler, so concurrent calls do
+  // not share penalty history
+  const auto lease =
+      m_context_pool->acquire(tokens.size() + m_prediction_length);
+  stats.context_ms = elapsed_ms(start_time) - stats.tokenize_ms;
+
+  const auto context = lease.get_context();
+  auto number_of_cached =
+      session_path.empty() ? 0U
+                           : restore_session(context, session_path, tokens);
+  if (number_of_cached == 0U) {
+    number_of_cached = restore_prefix(context, tokens);
   }
-  const auto context_size = llama_n_ctx(context.get());
+  stats.cached_tokens = number_of_cached;
 
-  auto batch = llama_batch_get_one(tokens.data(), tokens.size());
-  std::uint32_t number_of_decoded{0U};
-  llama_token new_token_id;
+  // Generated tokens may be appended to the prompt tokens
+  const auto prompt_size = tokens.size();
+  generate_tokens(context, lease.get_sampler(), tokens, number_of_cached,
+                  start_time, stats, out);
 
-  for (int token_position = 0; token_position + batch.n_tokens < context_size;
-       ++number_of_decoded) {
-    // Evaluate the current
-    const bool is_decoded = (llama_decode(context.get(), batch) == 0);
-    if (!is_decoded) {
-      throw std::runtime_error{"Cannot generate response: Failed to decode!"};
+  if (!session_path.empty()) {
+    save_session(context, session_path, {tokens.data(), prompt_size});
+  }
+  return stats;
+}
+
+std::optional<GenerationStats>
+Model::generate_streamed(const TokenSource &next_tokens,
+                         const std::size_t capacity, std::ostream &out) {
+  if (capacity <= m_prediction_length) {
+    throw std::runtime_error{"Cannot generate streamed: Invalid capacity!"};
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+  GenerationStats stats{};
+
+  // The context starts in the bucket of the tokens at the first decode and
+  // moves to larger buckets as the prompt grows, so a short input does not
+  // take a context of the whole capacity
+  std::optional<ContextPool::Lease> lease;
+  llama_context *context{nullptr};
+  const auto fit_context = [&](const std::size_t number_of_tokens) {
+    if (context != nullptr && number_of_tokens <= llama_n_ctx(context)) {
+      return;
     }
 
-    token_position += batch.n_tokens;
+    const auto context_start_time = std::chrono::steady_clock::now();
+    auto larger_lease = m_context_pool->acquire(number_of_tokens);
+    if (context != nullptr) {
+      std::vector<std::uint8_t> state(llama_state_seq_get_size(context, 0));
+      llama_state_seq_get_data(context, state.data(), state.size(), 0);
+      if (llama_state_seq_set_data(larger_lease.get_context(), state.data(),
+                                   state.size(), 0) == 0) {
+        throw std::runtime_error{
+            "Cannot generate streamed: Failed to grow context!"};
+      }
+    }
+    lease.reset();
+    lease.emplace(std::move(larger_lease));
+    context = lease->get_context();
+    stats.context_ms += elapsed_ms(context_start_time);
+  };
+
+  // Tokens are evaluated in full n_batch slices while the prompt still
+  // arrives, so only the tail is left when the source is done
+  const std::size_t batch_size = m_context_settings.n_batch;
+  std::vector<llama_token> tokens;
+  std::size_t prompt_position{0U};
+  bool is_prefix_restored{false};
+  bool has_more_tokens{true};
+
+  while (has_more_tokens) {
+    const auto tokenize_start_time = std::chrono::steady_clock::now();
+    has_more_tokens = next_tokens(tokens);
+    stats.tokenize_ms += elapsed_ms(tokenize_start_time);
 
-    // Sample the next token
-    new_token_id = llama_sampler_sample(m_sampler.get(), context.get(), -1);
+    if (tokens.size() + m_prediction_length > capacity) {
+      return std::nullopt;
+    }
+
+    // The prefix is restored right before the first decode, by then the
+    // tokens contain more than the prefix
+    if (!is_prefix_restored &&
+        (tokens.size() > batch_size || !has_more_tokens)) {
+      fit_context(tokens.size() + m_prediction_length);
+      prompt_position = restore_prefix(context, tokens);
+      stats.cached_tokens = prompt_position;
+      is_prefix_restored = true;
+    }
 
-    if (llama_vocab_is_eog(m_vocab, new_token_id)) {
+    if (context == nullptr) {
+      continue;
+    }
+    fit_context(tokens.size() + m_prediction_length);
+    const std::size_t context_batch_size = llama_n_batch(context);
+    for (; tokens.size() - prompt_position > context_batch_size;
+         prompt_position += context_batch_size) {
+      decode_tokens(context,
+                    {tokens.data() + prompt_position, context_batch_size});
+    }
+  }
+
+  if (tokens.empty()) {
+    throw std::runtime_error{"Cannot generate streamed: Prompt is empty!"};
+  }
+
+  generate_tokens(context, lease->get_sampler(), tokens, prompt_position,
+                  start_time, stats, out);
+  return stats;
+}
+
+void Model::generate_rolling(
+    const std::vector<llama_token> &prefix_tokens,
+    const std::vector<llama_token> &suffix_tokens,
+    const RollingSource &next_tokens, const std::size_t capacity,
+    std::ostream &out,
+    const std::function<void(const GenerationStats &stats)> &on_response) {
+  const auto lease = m_context_pool->acquire(capacity);
+  const auto context = lease.get_context();
+  const auto memory = llama_get_memory(context);
+  if (!llama_memory_can_shift(memory)) {
+    throw std::runtime_error{"Cannot follow: Context cannot be shifted!"};
+  }
+
+  // The window leaves room for the prefix, the suffix and the response
+  const std::size_t context_size = llama_n_ctx(context);
+  const auto reserved_size =
+      prefix_tokens.size() + suffix_tokens.size() + m_prediction_length + 1U;
+  if (context_size <= reserved_size) {
+    throw std::runtime_error{"Cannot follow: Context is too small!"};
+  }
+  const auto window_size = context_size - reserved_size;
+  const auto eviction_step = std::max<std::size_t>(window_size / 4U, 1U);
+  const auto prefix_size = prefix_tokens.size();
+
+  std::vector<llama_token> tokens = prefix_tokens;
+  decode_tokens(context, tokens);
+
+  std::vector<llama_token> new_tokens;
+  std::vector<llama_token> response_tokens;
+  RollingUpdate update{};
+  do {
+    new_tokens.clear();
+    update = next_tokens(new_tokens);
+
+    // Tokens that would be evicted right away are not evaluated at all
+    if (new_tokens.size() > window_size) {
+      new_tokens.erase(new_tokens.begin(), new_tokens.end() - window_size);
+    }
+
+    const auto document_size = tokens.size() - prefix_size;
+    if (document_size + new_tokens.size() > window_size) {
+      const auto number_of_evicted = std::min(
+          document_size, std::max(document_size + new_tokens.size() -
+                                      window_size,
+                                  eviction_step));
+      const auto start = static_cast<llama_pos>(prefix_size);
+      const auto end = static_cast<llama_pos>(prefix_size + number_of_evicted);
+      llama_memory_seq_rm(memory, 0, start, end);
+      llama_memory_seq_add(memory, 0, end, -1,
+                           -static_cast<llama_pos>(number_of_evicted));
+      tokens.erase(tokens.begin() + start, tokens.begin() + end);
+    }
+
+    if (!new_tokens.empty()) {
+      decode_tokens(context, new_tokens);
+      tokens.insert(tokens.end(), new_tokens.begin(), new_tokens.end());
+    }
+
+    if (!update.is_summary_due || tokens.size() == prefix_size) {
+      continue;
+    }
+
+    // Without a suffix the last document token is evaluated again for its
+    // logits
+    auto number_of_evaluated = tokens.size();
+    if (suffix_tokens.empty()) {
+      llama_memory_seq_rm(memory, 0, --number_of_evaluated, -1);
+    }
+    response_tokens = tokens;
+    response_tokens.insert(response_tokens.end(), suffix_tokens.begin(),
+                           suffix_tokens.end());
+
+    GenerationStats stats{};
+    stats.cached_tokens = number_of_evaluated;
+    generate_tokens(context, lease.get_sampler(), response_tokens,
+                    number_of_evaluated, std::chrono::steady_clock::now(),
+                    stats, out);
+
+    // The next response starts from the document again
+    llama_memory_seq_rm(memory, 0, tokens.size(), -1);
+    llama_sampler_reset(lease.get_sampler());
+    llama_perf_context_reset(context);
+    if (on_response) {
+      on_response(stats);
+    }
+  } while (!update.is_finished);
+}
+
+void Model::generate_tokens(llama_context *context, llama_sampler *sampler,
+                            std::vector<llama_token> &tokens,
+                            const std::size_t number_of_evaluated,
+                            const std::chrono::steady_clock::time_point
+                                start_time,
+                            GenerationStats &stats, std::ostream &out) {
+  const auto context_size = llama_n_ctx(context);
+  stats.prompt_tokens = tokens.size();
+  stats.context_size = context_size;
+
+  // Evaluate the prompt in slices of at most n_batch tokens so the compute
+  // buffers do not grow with the document, the last slice is decoded by the
+  // first iteration of the generation loop
+  const std::size_t batch_size = llama_n_batch(context);
+  std::size_t prompt_position = number_of_evaluated;
+  for (; tokens.size() - prompt_position > batch_size;
+       prompt_position += batch_size) {
+    decode_tokens(context, {tokens.data() + prompt_position, batch_size});
+  }
+
+  if (const auto draft_source = create_draft_source(context_size, tokens)) {
+    generate_speculative(context, sampler, *draft_source, tokens,
+                         prompt_position, start_time, stats, out);
+  } else {
+    auto batch = llama_batch_get_one(tokens.data() + prompt_position,
+                                     tokens.size() - prompt_position);
+    llama_token new_token_id;
+    auto previous_token_time = start_time;
+
+    // Pooled contexts can be larger than needed, so the prediction length is
+    // checked as well
+    for (int token_position = prompt_position;
+         token_position + batch.n_tokens < context_size &&
+         stats.generated_tokens < m_prediction_length;) {
+      // Evaluate the current
+      const bool is_decoded = (llama_decode(context, batch) == 0);
+      if (!is_decoded) {
+        throw std::runtime_error{
+            "Cannot generate response: Failed to decode!"};
+      }
+
+      token_position += batch.n_tokens;
+
+      if (stats.target_decodes++ == 0U) {
+        stats.prefill_ms = elapsed_ms(start_time);
+      }
+
+      // Sample the next token
+      new_token_id = llama_sampler_sample(sampler, context, -1);
+
+      if (llama_vocab_is_eog(m_vocab, new_token_id)) {
+        break;
+      }
+
+      write_token(new_token_id, start_time, previous_token_time, stats, out);
+
+      // Prepare the next batch
+      batch = llama_batch_get_one(&new_token_id, 1);
+    }
+  }
+
+  out << '\n';
+
+  stats.decode_ms = elapsed_ms(start_time) - stats.prefill_ms;
+
+  // Counters of pooled contexts are reset on release, so they only cover
+  // this response
+  const auto perf = llama_perf_context(context);
+  stats.llama_prompt_eval_ms = perf.t_p_eval_ms;
+  stats.llama_prompt_eval_tokens = perf.n_p_eval;
+  stats.llama_eval_ms = perf.t_eval_ms;
+  stats.llama_eval_tokens = perf.n_eval;
+  stats.kv_bytes = llama_state_seq_get_size(context, 0);
+}
+
+void Model::generate_speculative(
+    llama_context *context, llama_sampler *sampler, DraftSource &draft_source,
+    std::vector<llama_token> &tokens, const std::size_t number_of_evaluated,
+    const std::chrono::steady_clock::time_point start_time,
+    GenerationStats &stats, std::ostream &out) {
+  const std::size_t context_size = llama_n_ctx(context);
+  const std::size_t batch_size = llama_n_batch(context);
+  const auto memory = llama_get_memory(context);
+
+  // The last prompt slice gives the first token
+  const auto prompt_batch =
+      llama_batch_get_one(tokens.data() + number_of_evaluated,
+                          tokens.size() - number_of_evaluated);
+  if (llama_decode(context, prompt_batch) != 0) {
+    throw std::runtime_error{"Cannot generate response: Failed to decode!"};
+  }
+  ++stats.target_decodes;
+  stats.prefill_ms = elapsed_ms(start_time);
+
+  auto new_token_id = llama_sampler_sample(sampler, context, -1);
+  auto previous_token_time = start_time;
+  auto number_of_drafted = m_speculative_settings.initial_draft_tokens;
+  std::vector<llama_token> drafted;
+  BatchGuard verification{static_cast<int32_t>(batch_size)};
+
+  while (!llama_vocab_is_eog(m_vocab, new_token_id)) {
+    write_token(new_token_id, start_time, previous_token_time, stats, out);
+    tokens.push_back(new_token_id);
+
+    if (stats.generated_tokens >= m_prediction_length ||
+        tokens.size() >= context_size) {
       break;
     }
 
-    std::string token_buffer(256, '\0');
-    const bool is_render_special_tokens{true};
-    const int32_t lstrip{0};
-    auto token_string_size = llama_token_to_piece(
-        m_vocab, new_token_id, token_buffer.data(), token_buffer.size(), lstrip,
-        is_render_special_tokens);
-    if (token_string_size < 0) {
-      throw std::runtime_error{
-          "Cannot generate response: Failed to convert token to string!"};
+    // Proposals beyond the context, the prediction length or the batch
+    // could never be used
+    const auto max_drafted = std::min(
+        {number_of_drafted, context_size - tokens.size() - 1U,
+         m_prediction_length - stats.generated_tokens - 1U, batch_size - 1U});
+    drafted.clear();
+    if (max_drafted > 0U) {
+      draft_source.draft(tokens, max_drafted, drafted);
+      drafted.resize(std::min(drafted.size(), max_drafted));
     }
 
-    std::string_view token_string{token_buffer.data(),
-                                  static_cast<size_t>(token_string_size)};
-    out << token_string;
-    out.flush();
+    // The sampled token and the proposals after it are evaluated together
+    auto &batch = verification.batch;
+    batch.n_tokens = 0;
+    const auto position = static_cast<llama_pos>(tokens.size() - 1U);
+    add_to_batch(batch, new_token_id, position, 0, true);
+    for (std::size_t i = 0U; i < drafted.size(); ++i) {
+      add_to_batch(batch, drafted[i], position + 1 + i, 0, true);
+    }
+    if (llama_decode(context, batch) != 0) {
+      throw std::runtime_error{"Cannot generate response: Failed to decode!"};
+    }
+    ++stats.target_decodes;
+    stats.draft_tokens += drafted.size();
 
-    // Prepare the next batch
-    batch = llama_batch_get_one(&new_token_id, 1);
+    std::size_t number_of_accepted{0U};
+    new_token_id = llama_sampler_sample(sampler, context, 0);
+    while (number_of_accepted < drafted.size() &&
+           new_token_id == drafted[number_of_accepted] &&
+           !llama_vocab_is_eog(m_vocab, new_token_id)) {
+      write_token(new_token_id, start_time, previous_token_time, stats, out);
+      tokens.push_back(new_token_id);
+      ++number_of_accepted;
+      new_token_id =
+          llama_sampler_sample(sampler, context, number_of_accepted);
+    }
+    stats.accepted_draft_tokens += number_of_accepted;
+
+    // Rejected proposals must not stay in the KV cache
+    llama_memory_seq_rm(memory, 0, tokens.size(), -1);
+
+    if (drafted.empty()) {
+      continue;
+    }
+    if (number_of_accepted == drafted.size()) {
+      number_of_drafted = std::min(number_of_drafted + 1U,
+                                   m_speculative_settings.max_draft_tokens);
+    } else if (number_of_accepted * 2U < drafted.size()) {
+      number_of_drafted = std::max<std::size_t>(number_of_drafted - 1U, 1U);
+    }
   }
+}
+
+void Model::write_token(
+    const llama_token token,
+    const std::chrono::steady_clock::time_point start_time,
+    std::chrono::steady_clock::time_point &previous_token_time,
+    GenerationStats &stats, std::ostream &out) const {
+  const auto output_start_time = std::chrono::steady_clock::now();
+  out << token_to_piece(token);
+  out.flush();
+  ++stats.generated_tokens;
+
+  const auto token_time = std::chrono::steady_clock::now();
+  stats.output_ms += std::chrono::duration<double, std::milli>(
+                         token_time - output_start_time)
+                         .count();
+  if (stats.generated_tokens == 1U) {
+    stats.time_to_first_token_ms =
+        std::chrono::duration<double, std::milli>(token_time - start_time)
+            .count();
+  } else {
+    stats.token_latencies_ms.push_back(
+        std::chrono::duration<double, std::milli>(token_time -
+                                                  previous_token_time)
+            .count());
+  }
+  previous_token_time = token_time;
+}
 
-  out << std::endl;
+void Model::generate_batched(const SequenceRequestSource &next_request,
+                             const std::size_t number_of_sequences,
+                             const std::size_t sequence_capacity) {
+  if (number_of_sequences == 0U || sequence_capacity <= m_prediction_length) {
+    throw std::runtime_error{"Cannot generate batched: Invalid capacity!"};
+  }
+
+  std::deque<PendingSequence> pending;
+  bool is_source_drained{false};
+
+  // Tokenize the next valid request, false once the source is drained
+  const auto pull_request = [&]() {
+    while (!is_source_drained) {
+      auto request = next_request();
+      if (!request) {
+        is_source_drained = true;
+        break;
+      }
+
+      const auto tokenize_start_time = std::chrono::steady_clock::now();
+      auto tokens = request->prompt_tokens.empty()
+                        ? tokenize_prompt(request->prompt)
+                        : std::move(request->prompt_tokens);
+      if (tokens.empty() ||
+          tokens.size() + m_prediction_length > sequence_capacity) {
+        const std::string message{
+            "Cannot generate response: Prompt does not fit the sequence!"};
+        if (!request->on_error) {
+          throw std::runtime_error{message};
+        }
+        request->on_error(message);
+        continue;
+      }
+
+      pending.push_back(
+          {std::move(*request), std::move(tokens), tokenize_start_time});
+      return true;
+    }
+    return false;
+  };
+
+  llama_context_ptr context{nullptr};
+  llama_memory_t memory{nullptr};
+  std::size_t cache_size{0U};
+  std::size_t reserved_tokens{0U};
+
+  // The sequences share one cache sized for the next requests, instead of
+  // a whole sequence capacity for each of them
+  const auto create_shared_context = [&]() {
+    while (pending.size() < number_of_sequences && pull_request()) {
+    }
+    cache_size = 0U;
+    for (std::size_t i = 0U; i < std::min(pending.size(), number_of_sequences);
+         ++i) {
+      cache_size += pending[i].tokens.size() + m_prediction_length;
+    }
+
+    auto context_params = llama_context_default_params();
+    context_params.n_ctx = cache_size;
+    context_params.n_seq_max = number_of_sequences;
+    context_params.kv_unified = true;
+    apply_context_settings(context_params);
+
+    context.reset();
+    context = llama_context_ptr{
+        llama_init_from_model(m_model.get(), context_params)};
+    if (!context) {
+      throw std::runtime_error{
+          "Cannot generate batched: Failed to initialize context!"};
+    }
+    memory = llama_get_memory(context.get());
+  };
+
+  BatchGuard batch_guard{static_cast<int32_t>(m_context_settings.n_batch)};
+  auto &batch = batch_guard.batch;
+
+  std::vector<Sequence> sequences(number_of_sequences);
+  // Requests admitted ahead of the oldest pending one, which did not fit
+  std::size_t number_of_bypasses{0U};
+
+  while (true) {
+    // Admit pending requests into the free sequences while their tokens fit
+    // into the cache next to the active ones. Smaller requests behind one
+    // that does not fit yet may go first, but only number_of_sequences
+    // times, then the cache is left to drain for it
+    for (auto &sequence : sequences) {
+      if (sequence.request) {
+        continue;
+      }
+
+      std::size_t index{0U};
+      bool is_fitting{false};
+      while (index < pending.size() ||
+             (index < number_of_sequences && pull_request())) {
+        if (reserved_tokens + pending[index].tokens.size() +
+                m_prediction_length <=
+            cache_size) {
+          is_fitting = true;
+          break;
+        }
+        if (number_of_bypasses >= number_of_sequences) {
+          break;
+        }
+        ++index;
+      }
+      if (!is_fitting) {
+        break;
+      }
+      number_of_bypasses = index > 0U ? number_of_bypasses + 1U : 0U;
+
+      auto next = std::move(pending[index]);
+      pending.erase(pending.begin() + index);
+      const auto capacity = next.tokens.size() + m_prediction_length;
+      sequence.request = std::move(next.request);
+      sequence.tokens = std::move(next.tokens);
+      sequence.number_of_evaluated = 0U;
+      sequence.capacity = capacity;
+      sequence.sampler =
+          llama_sampler_ptr{llama_sampler_clone(m_sampler.get())};
+      sequence.stats = GenerationStats{};
+      sequence.stats.prompt_tokens = sequence.tokens.size();
+      sequence.stats.tokenize_ms = elapsed_ms(next.tokenize_start_time);
+      sequence.stats.context_size = capacity;
+      sequence.start_time = next.tokenize_start_time;
+      reserved_tokens += capacity;
+    }
+
+    // Without active sequences the next request does not fit the cache, it
+    // is created again for the pending requests
+    if (std::none_of(sequences.begin(), sequences.end(),
+                     [](const Sequence &sequence) {
+                       return sequence.request.has_value();
+                     })) {
+      if (pending.empty()) {
+        break;
+      }
+      create_shared_context();
+      reserved_tokens = 0U;
+      continue;
+    }
+
+    const auto batch_capacity = llama_n_batch(context.get());
+    batch.n_tokens = 0;
+
+    // Generating sequences add a single token each, they go first so that a
+    // long prompt cannot stall them
+    for (std::size_t id = 0U; id < sequences.size(); ++id) {
+      auto &sequence = sequences[id];
+      sequence.logits_index = -1;
+      if (sequence.request &&
+          sequence.number_of_evaluated + 1U == sequence.tokens.size() &&
+          sequence.stats.generated_tokens > 0U) {
+        sequence.logits_index = batch.n_tokens;
+        add_to_batch(batch, sequence.tokens.back(),
+                     sequence.number_of_evaluated, id, true);
+      }
+    }
+
+    // Prompts fill the rest of the batch
+    for (std::size_t id = 0U; id < sequences.size(); ++id) {
+      auto &sequence = sequences[id];
+      if (!sequence.request || sequence.stats.generated_tokens > 0U) {
+        continue;
+      }
+
+      while (sequence.number_of_evaluated < sequence.tokens.size() &&
+             batch.n_tokens < static_cast<int32_t>(batch_capacity)) {
+        const bool is_last =
+            sequence.number_of_evaluated + 1U == sequence.tokens.size();
+        if (is_last) {
+          sequence.logits_index = batch.n_tokens;
+        }
+        add_to_batch(batch, sequence.tokens[sequence.number_of_evaluated],
+                     sequence.number_of_evaluated, id, is_last);
+        ++sequence.number_of_evaluated;
+      }
+      // The last prompt token stays counted as not evaluated until sampled
+      if (sequence.logits_index >= 0) {
+        --sequence.number_of_evaluated;
+      }
+    }
+
+    if (batch.n_tokens == 0) {
+      break;
+    }
+
+    if (llama_decode(context.get(), batch) != 0) {
+      throw std::runtime_error{"Cannot generate batched: Failed to decode!"};
+    }
+
+    for (std::size_t id = 0U; id < sequences.size(); ++id) {
+      auto &sequence = sequences[id];
+      if (sequence.logits_index < 0) {
+        continue;
+      }
+
+      if (sequence.stats.generated_tokens == 0U) {
+        sequence.stats.prefill_ms = elapsed_ms(sequence.start_time);
+      }
+
+      const auto new_token_id = llama_sampler_sample(
+          sequence.sampler.get(), context.get(), sequence.logits_index);
+      ++sequence.number_of_evaluated;
+      ++sequence.stats.target_decodes;
+
+      const bool is_finished =
+          llama_vocab_is_eog(m_vocab, new_token_id) ||
+          sequence.stats.generated_tokens >= m_prediction_length ||
+          sequence.number_of_evaluated + 1U >= sequence.capacity;
+
+      if (!is_finished) {
+        // A sequence counts as generating once it has its first token
+        const auto output_start_time = std::chrono::steady_clock::now();
+        ++sequence.stats.generated_tokens;
+        sequence.tokens.push_back(new_token_id);
+        sequence.request->on_piece(token_to_piece(new_token_id));
+
+        const auto token_time = std::chrono::steady_clock::now();
+        sequence.stats.output_ms += std::chrono::duration<double, std::milli>(
+                                        token_time - output_start_time)
+                                        .count();
+        if (sequence.stats.generated_tokens == 1U) {
+          sequence.stats.time_to_first_token_ms =
+              elapsed_ms(sequence.start_time);
+        } else {
+          sequence.stats.token_latencies_ms.push_back(
+              std::chrono::duration<double, std::milli>(
+                  token_time - sequence.previous_token_time)
+                  .count());
+        }
+        sequence.previous_token_time = token_time;
+        continue;
+      }
+
+      sequence.stats.decode_ms =
+          elapsed_ms(sequence.start_time) - sequence.stats.prefill_ms;
+      sequence.stats.kv_bytes = llama_state_seq_get_size(context.get(), id);
+      llama_memory_seq_rm(memory, id, -1, -1);
+      reserved_tokens -= sequence.capacity;
+      auto request = std::move(*sequence.request);
+      sequence.request.reset();
+      request.on_finished(sequence.stats);
+    }
+  }
 }
 } // namespace model_wrapper
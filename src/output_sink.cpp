@@ -0,0 +1,294 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: output_sink.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "output_sink.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace model_wrapper {
+
+namespace {
+/**
+ * \brief Size of the local buffer the producer writes into
+ */
+constexpr std::size_t LOCAL_BUFFER_SIZE{4096U};
+
+std::size_t parse_positive(const std::string_view text) {
+  std::size_t value{0U};
+  const auto result =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (result.ec != std::errc{} || result.ptr != text.data() + text.size() ||
+      value == 0U) {
+    throw std::invalid_argument{"Invalid flush policy value: " +
+                                std::string{text}};
+  }
+  return value;
+}
+} // namespace
+
+FlushSettings parse_flush_settings(const std::string_view text) {
+  FlushSettings settings{};
+  if (text == "token") {
+    settings.policy = FlushPolicy::Token;
+  } else if (text == "line") {
+    settings.policy = FlushPolicy::Line;
+  } else if (text == "end") {
+    settings.policy = FlushPolicy::End;
+  } else if (text.starts_with("tokens:")) {
+    settings.policy = FlushPolicy::Tokens;
+    settings.number_of_tokens = parse_positive(text.substr(7U));
+  } else if (text.starts_with("ms:")) {
+    settings.policy = FlushPolicy::Interval;
+    settings.interval =
+        std::chrono::milliseconds{parse_positive(text.substr(3U))};
+  } else {
+    throw std::invalid_argument{"Unknown flush policy: " + std::string{text}};
+  }
+  return settings;
+}
+
+OutputSink::OutputSink(std::ostream &destination, const FlushSettings &settings,
+                       const std::size_t ring_size)
+    : m_destination(destination), m_settings(settings),
+      m_buffer(LOCAL_BUFFER_SIZE),
+      m_ring(std::bit_ceil(std::max(ring_size, LOCAL_BUFFER_SIZE))),
+      m_ring_mask(m_ring.size() - 1U) {
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  m_writer = std::jthread{[this]() { run_writer(); }};
+}
+
+OutputSink::~OutputSink() {
+  try {
+    close();
+  } catch (...) {
+    // Destructors must not throw, call close() to see the error
+  }
+}
+
+void OutputSink::close() {
+  if (m_is_closed) {
+    return;
+  }
+  m_is_closed = true;
+
+  publish(true);
+  m_is_closing.store(true, std::memory_order_release);
+  notify_writer();
+  m_writer.join();
+
+  if (m_is_failed.load(std::memory_order_acquire)) {
+    throw std::runtime_error{"Failed to write output!"};
+  }
+}
+
+OutputSink::int_type OutputSink::overflow(const int_type character) {
+  if (m_is_closed) {
+    return traits_type::eof();
+  }
+
+  // The buffer is full, hand it to the writer without a flush
+  publish(false);
+  if (!traits_type::eq_int_type(character, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(character);
+    pbump(1);
+  }
+  return traits_type::not_eof(character);
+}
+
+int OutputSink::sync() {
+  if (m_is_closed) {
+    return 0;
+  }
+
+  // The writer flushes by time, so it needs to see every token
+  if (m_settings.policy == FlushPolicy::Interval) {
+    publish(false);
+    return 0;
+  }
+
+  ++m_unflushed_tokens;
+  if (is_flush_due()) {
+    publish(true);
+    m_unflushed_tokens = 0U;
+    m_has_unflushed_line = false;
+  }
+  return 0;
+}
+
+bool OutputSink::is_flush_due() {
+  switch (m_settings.policy) {
+  case FlushPolicy::Token:
+    return true;
+  case FlushPolicy::Line:
+    return m_has_unflushed_line ||
+           std::memchr(pbase(), '\n', pptr() - pbase()) != nullptr;
+  case FlushPolicy::Tokens:
+    return m_unflushed_tokens >= m_settings.number_of_tokens;
+  case FlushPolicy::Interval:
+  case FlushPolicy::End:
+    return false;
+  }
+  return false;
+}
+
+void OutputSink::publish(const bool is_flush_needed) {
+  const auto size = static_cast<std::size_t>(pptr() - pbase());
+  if (m_settings.policy == FlushPolicy::Line && !m_has_unflushed_line) {
+    m_has_unflushed_line = std::memchr(pbase(), '\n', size) != nullptr;
+  }
+  write_to_ring(pbase(), size);
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+
+  if (is_flush_needed) {
+    m_flush_position.store(m_write_position, std::memory_order_release);
+    notify_writer();
+  }
+}
+
+void OutputSink::write_to_ring(const char *data, std::size_t size) {
+  while (size > 0U) {
+    // Only wait if the writer is a whole ring behind
+    auto tail = m_tail.load(std::memory_order_acquire);
+    while (m_write_position - tail == m_ring.size()) {
+      m_tail.wait(tail, std::memory_order_acquire);
+      tail = m_tail.load(std::memory_order_acquire);
+    }
+
+    const auto index = m_write_position & m_ring_mask;
+    const auto length =
+        std::min({size, m_ring.size() - (m_write_position - tail),
+                  m_ring.size() - index});
+    std::memcpy(m_ring.data() + index, data, length);
+    m_write_position += length;
+    data += length;
+    size -= length;
+
+    m_head.store(m_write_position, std::memory_order_release);
+    notify_writer();
+  }
+}
+
+void OutputSink::notify_writer() {
+  m_events.fetch_add(1U, std::memory_order_release);
+  if (m_settings.policy != FlushPolicy::Interval) {
+    m_events.notify_one();
+    return;
+  }
+
+  // Taking the lock orders the event before the check of a waiting writer,
+  // so the notification cannot be lost
+  {
+    const std::lock_guard lock{m_wakeup_mutex};
+  }
+  m_wakeup.notify_one();
+}
+
+void OutputSink::wait_for_events(
+    const std::uint32_t events,
+    const std::optional<std::chrono::steady_clock::time_point> &deadline) {
+  if (m_settings.policy != FlushPolicy::Interval) {
+    m_events.wait(events, std::memory_order_acquire);
+    return;
+  }
+
+  const auto has_events = [this, events]() {
+    return m_events.load(std::memory_order_acquire) != events;
+  };
+  std::unique_lock lock{m_wakeup_mutex};
+  if (deadline) {
+    m_wakeup.wait_until(lock, *deadline, has_events);
+  } else {
+    m_wakeup.wait(lock, has_events);
+  }
+}
+
+void OutputSink::run_writer() {
+  std::uint64_t tail{0U};
+  std::uint64_t flushed_position{0U};
+  auto last_flush_time = std::chrono::steady_clock::now();
+
+  while (true) {
+    const auto events = m_events.load(std::memory_order_acquire);
+    const auto head = m_head.load(std::memory_order_acquire);
+
+    while (tail != head) {
+      const auto index = tail & m_ring_mask;
+      const auto length = std::min(head - tail, m_ring.size() - index);
+      if (!m_destination.write(m_ring.data() + index, length)) {
+        m_is_failed.store(true, std::memory_order_release);
+      }
+      tail += length;
+      m_tail.store(tail, std::memory_order_release);
+      m_tail.notify_one();
+    }
+
+    const auto flush_position =
+        m_flush_position.load(std::memory_order_acquire);
+    if (flush_position > flushed_position && tail >= flush_position) {
+      if (!m_destination.flush()) {
+        m_is_failed.store(true, std::memory_order_release);
+      }
+      flushed_position = flush_position;
+      last_flush_time = std::chrono::steady_clock::now();
+    }
+
+    // Written text waits at most one interval, whether tokens arrive or not
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (m_settings.policy == FlushPolicy::Interval &&
+        tail > flushed_position) {
+      deadline = last_flush_time + m_settings.interval;
+      if (std::chrono::steady_clock::now() >= *deadline) {
+        if (!m_destination.flush()) {
+          m_is_failed.store(true, std::memory_order_release);
+        }
+        flushed_position = tail;
+        last_flush_time = std::chrono::steady_clock::now();
+        deadline.reset();
+      }
+    }
+
+    if (m_is_closing.load(std::memory_order_acquire) &&
+        tail == m_head.load(std::memory_order_acquire)) {
+      if (!m_destination.flush()) {
+        m_is_failed.store(true, std::memory_order_release);
+      }
+      return;
+    }
+
+    wait_for_events(events, deadline);
+  }
+}
+
+CaptureBuffer::CaptureBuffer(std::streambuf *destination)
+    : m_destination(destination) {}
+
+CaptureBuffer::int_type CaptureBuffer::overflow(int_type character) {
+  if (traits_type::eq_int_type(character, traits_type::eof())) {
+    return traits_type::not_eof(character);
+  }
+  m_text.push_back(traits_type::to_char_type(character));
+  return m_destination->sputc(traits_type::to_char_type(character));
+}
+
+std::streamsize CaptureBuffer::xsputn(const char *data,
+                                      const std::streamsize size) {
+  m_text.append(data, static_cast<std::size_t>(size));
+  return m_destination->sputn(data, size);
+}
+
+int CaptureBuffer::sync() { return m_destination->pubsync(); }
+
+const std::string &CaptureBuffer::get_text() const { return m_text; }
+} // namespace model_wrapper
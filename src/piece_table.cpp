@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: piece_table.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "piece_table.h"
+#include <chrono>
+#include <stdexcept>
+
+namespace model_wrapper {
+
+PieceTable::PieceTable(const llama_vocab *vocab) {
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto number_of_tokens = llama_vocab_n_tokens(vocab);
+  const bool is_render_special_tokens{true};
+  const int32_t lstrip{0};
+
+  // Most pieces are a few bytes, reserve for the average to grow rarely
+  m_offsets.reserve(number_of_tokens + 1U);
+  m_arena.reserve(number_of_tokens * 8U);
+  m_offsets.push_back(0U);
+
+  std::string piece(256, '\0');
+  for (llama_token token = 0; token < number_of_tokens; ++token) {
+    auto piece_size =
+        llama_token_to_piece(vocab, token, piece.data(), piece.size(), lstrip,
+                             is_render_special_tokens);
+    if (piece_size < 0) {
+      piece.resize(-piece_size);
+      piece_size = llama_token_to_piece(vocab, token, piece.data(),
+                                        piece.size(), lstrip,
+                                        is_render_special_tokens);
+    }
+    if (piece_size < 0) {
+      throw std::runtime_error{"Failed to render the vocabulary pieces!"};
+    }
+
+    m_arena.append(piece.data(), piece_size);
+    m_offsets.push_back(static_cast<std::uint32_t>(m_arena.size()));
+  }
+
+  m_arena.shrink_to_fit();
+  m_build_ms = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start_time)
+                   .count();
+}
+
+std::string_view PieceTable::get_piece(const llama_token token) const {
+  if (token < 0 || static_cast<std::size_t>(token) + 1U >= m_offsets.size()) {
+    throw std::runtime_error{
+        "Cannot generate response: Failed to convert token to string!"};
+  }
+
+  const auto begin = m_offsets[token];
+  return std::string_view{m_arena}.substr(begin, m_offsets[token + 1] - begin);
+}
+
+std::size_t PieceTable::size() const { return m_offsets.size() - 1U; }
+
+std::size_t PieceTable::get_memory_bytes() const {
+  return m_arena.capacity() + m_offsets.capacity() * sizeof(std::uint32_t);
+}
+
+double PieceTable::get_build_ms() const { return m_build_ms; }
+} // namespace model_wrapper
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: prefix_cache.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "prefix_cache.h"
+#include "hash.h"
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace model_wrapper {
+
+PrefixCache::PrefixCache(std::filesystem::path directory,
+                         const std::uint64_t model_fingerprint,
+                         const std::uint64_t layout_fingerprint,
+                         const std::string_view prefix_text,
+                         std::vector<llama_token> prefix_tokens)
+    : m_directory(std::move(directory)),
+      m_prefix_tokens(std::move(prefix_tokens)) {
+  std::filesystem::create_directories(m_directory);
+
+  const auto entry_name = to_hex(model_fingerprint) + "-" +
+                          to_hex(layout_fingerprint) + "-" +
+                          to_hex(hash_bytes(prefix_text)) +
+                          std::string{ENTRY_EXTENSION};
+  m_entry_path = m_directory / entry_name;
+}
+
+const std::vector<llama_token> &PrefixCache::get_prefix_tokens() const {
+  return m_prefix_tokens;
+}
+
+bool PrefixCache::restore(llama_context *context) {
+  const std::lock_guard lock{m_mutex};
+
+  if (!m_state.empty()) {
+    if (llama_state_seq_set_data(context, m_state.data(), m_state.size(), 0) ==
+        0) {
+      llama_memory_seq_rm(llama_get_memory(context), 0, -1, -1);
+      return false;
+    }
+    return true;
+  }
+
+  std::error_code error;
+  if (!std::filesystem::exists(m_entry_path, error)) {
+    return false;
+  }
+
+  std::vector<llama_token> stored_tokens(m_prefix_tokens.size() + 1U);
+  std::size_t number_of_stored_tokens{0U};
+  const bool is_loaded =
+      llama_state_seq_load_file(context, m_entry_path.c_str(), 0,
+                                stored_tokens.data(), stored_tokens.size(),
+                                &number_of_stored_tokens) != 0;
+  stored_tokens.resize(is_loaded ? number_of_stored_tokens : 0U);
+
+  if (!is_loaded || stored_tokens != m_prefix_tokens) {
+    // Written by another llama.cpp version or for another prefix
+    llama_memory_seq_rm(llama_get_memory(context), 0, -1, -1);
+    std::filesystem::remove(m_entry_path, error);
+    return false;
+  }
+
+  m_state.resize(llama_state_seq_get_size(context, 0));
+  llama_state_seq_get_data(context, m_state.data(), m_state.size(), 0);
+
+  return true;
+}
+
+void PrefixCache::store(llama_context *context) {
+  const std::lock_guard lock{m_mutex};
+
+  m_state.resize(llama_state_seq_get_size(context, 0));
+  llama_state_seq_get_data(context, m_state.data(), m_state.size(), 0);
+
+  // Write to a temporary file first so other processes never read a
+  // partially written entry
+  auto temporary_path = m_entry_path;
+  temporary_path += ".tmp" + std::to_string(getpid());
+
+  const bool is_saved =
+      llama_state_seq_save_file(context, temporary_path.c_str(), 0,
+                                m_prefix_tokens.data(),
+                                m_prefix_tokens.size()) != 0;
+
+  std::error_code error;
+  if (is_saved) {
+    std::filesystem::rename(temporary_path, m_entry_path, error);
+  }
+  if (!is_saved || error) {
+    std::filesystem::remove(temporary_path, error);
+  }
+}
+
+std::size_t PrefixCache::clear(const std::filesystem::path &directory) {
+  std::error_code error;
+  if (!std::filesystem::is_directory(directory, error)) {
+    return 0U;
+  }
+
+  std::size_t number_of_removed{0U};
+  for (const auto &entry :
+       std::filesystem::directory_iterator{directory, error}) {
+    if (entry.is_regular_file(error) &&
+        entry.path().extension() == ENTRY_EXTENSION &&
+        std::filesystem::remove(entry.path(), error)) {
+      ++number_of_removed;
+    }
+  }
+
+  return number_of_removed;
+}
+} // namespace model_wrapper
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: prompt_builder.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "prompt_builder.h"
+#include <string>
+#include <vector>
+
+namespace model_wrapper {
+
+namespace {
+/**
+ * \brief Stands for the text when the chat template is applied once
+ */
+constexpr std::string_view TEXT_PLACEHOLDER{"\x1f\x1e"};
+} // namespace
+
+PromptBuilder::PromptBuilder(Model &model, std::string system_prompt,
+                             std::string user_prompt_end)
+    : m_model(model), m_system_prompt(std::move(system_prompt)),
+      m_user_prompt_end(std::move(user_prompt_end)) {
+  const auto formatted_prompt = apply_template(TEXT_PLACEHOLDER);
+  const auto position = formatted_prompt.find(TEXT_PLACEHOLDER);
+
+  // The template changed the text, e.g. trimmed or escaped it
+  if (position == std::string::npos) {
+    return;
+  }
+
+  m_prefix = formatted_prompt.substr(0U, position);
+  m_suffix = formatted_prompt.substr(position + TEXT_PLACEHOLDER.size());
+  m_prefix_tokens = m_model.tokenize_template(m_prefix, true);
+  m_suffix_tokens = m_model.tokenize_template(m_suffix, false);
+  m_is_split = true;
+}
+
+std::string PromptBuilder::apply_template(const std::string_view text) const {
+  std::string user_prompt;
+  user_prompt.reserve(text.size() + m_user_prompt_end.size());
+  user_prompt.append(text).append(m_user_prompt_end);
+
+  std::vector<llama_chat_message> messages;
+  messages.push_back({"system", m_system_prompt.c_str()});
+  messages.push_back({"user", user_prompt.c_str()});
+
+  return m_model.get_formatted_prompt(messages);
+}
+
+std::string PromptBuilder::format(const std::string_view text) const {
+  if (!m_is_split) {
+    return apply_template(text);
+  }
+
+  std::string formatted_prompt;
+  formatted_prompt.reserve(m_prefix.size() + text.size() + m_suffix.size());
+  formatted_prompt.append(m_prefix).append(text).append(m_suffix);
+  return formatted_prompt;
+}
+
+std::vector<llama_token>
+PromptBuilder::build(const std::string_view text) const {
+  if (!m_is_split) {
+    return m_model.tokenize_template(apply_template(text), true);
+  }
+
+  std::vector<llama_token> tokens;
+  tokens.reserve(m_prefix_tokens.size() + Model::estimate_tokens(text.size()) +
+                 m_suffix_tokens.size());
+  tokens.assign(m_prefix_tokens.begin(), m_prefix_tokens.end());
+  m_model.tokenize_text_into(text, tokens);
+  tokens.insert(tokens.end(), m_suffix_tokens.begin(), m_suffix_tokens.end());
+  return tokens;
+}
+
+std::vector<llama_token>
+PromptBuilder::build(const std::span<const llama_token> text_tokens) const {
+  if (!m_is_split) {
+    return build(m_model.detokenize(text_tokens));
+  }
+
+  std::vector<llama_token> tokens;
+  tokens.reserve(m_prefix_tokens.size() + text_tokens.size() +
+                 m_suffix_tokens.size());
+  tokens.assign(m_prefix_tokens.begin(), m_prefix_tokens.end());
+  tokens.insert(tokens.end(), text_tokens.begin(), text_tokens.end());
+  tokens.insert(tokens.end(), m_suffix_tokens.begin(), m_suffix_tokens.end());
+  return tokens;
+}
+
+bool PromptBuilder::is_split() const { return m_is_split; }
+
+const std::string &PromptBuilder::get_prefix() const { return m_prefix; }
+
+const std::string &PromptBuilder::get_suffix() const { return m_suffix; }
+
+const std::vector<llama_token> &PromptBuilder::get_prefix_tokens() const {
+  return m_prefix_tokens;
+}
+
+const std::vector<llama_token> &PromptBuilder::get_suffix_tokens() const {
+  return m_suffix_tokens;
+}
+} // namespace model_wrapper
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: startup.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "startup.h"
+#include "llama-cpp.h"
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace model_wrapper {
+
+double initialize_backend() {
+  static std::once_flag once;
+  double backend_ms{0.0};
+
+  std::call_once(once, [&backend_ms]() {
+    const auto start_time = std::chrono::steady_clock::now();
+    llama_log_set(
+        [](auto log_level, const char *log_message, auto /* user_data */) {
+          if (log_level >= GGML_LOG_LEVEL_ERROR) {
+            std::cerr << log_message;
+          }
+        },
+        nullptr);
+
+    ggml_backend_load_all();
+    backend_ms = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  });
+
+  return backend_ms;
+}
+
+WeightPrefetcher::WeightPrefetcher(std::filesystem::path model_path)
+    : m_thread([this, model_path = std::move(model_path)](
+                   const std::stop_token stop_token) {
+        prefetch(stop_token, model_path);
+      }) {}
+
+void WeightPrefetcher::prefetch(const std::stop_token &stop_token,
+                                const std::filesystem::path &model_path) {
+  const auto start_time = std::chrono::steady_clock::now();
+  const int file_descriptor = open(model_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file_descriptor < 0) {
+    return;
+  }
+
+  struct stat file_status{};
+  if (fstat(file_descriptor, &file_status) != 0) {
+    close(file_descriptor);
+    return;
+  }
+  const auto file_size = static_cast<std::size_t>(file_status.st_size);
+
+  // llama.cpp makes its own mapping, so the pages are read into the shared
+  // page cache instead of being advised through a mapping of this thread
+  for (std::size_t offset = 0U;
+       offset < file_size && !stop_token.stop_requested();
+       offset += WINDOW_SIZE) {
+    const auto length = std::min(WINDOW_SIZE, file_size - offset);
+    if (readahead(file_descriptor, static_cast<off_t>(offset), length) != 0) {
+      break;
+    }
+    m_prefetched_bytes += length;
+  }
+  close(file_descriptor);
+
+  if (m_prefetched_bytes == file_size) {
+    m_prefetch_submit_ms = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start_time)
+                               .count();
+  }
+}
+
+std::size_t WeightPrefetcher::get_prefetched_bytes() const {
+  return m_prefetched_bytes;
+}
+
+double WeightPrefetcher::get_prefetch_submit_ms() const {
+  return m_prefetch_submit_ms;
+}
+} // namespace model_wrapper
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: stats_report.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stats_report.h"
+#include "json_writer.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace model_wrapper {
+
+namespace {
+double per_second(const double count, const double milliseconds) {
+  return milliseconds > 0.0 ? count * 1000.0 / milliseconds : 0.0;
+}
+
+double ratio(const double count, const double total) {
+  return total > 0.0 ? count / total : 0.0;
+}
+} // namespace
+
+std::string make_stats_record(const SummaryStats &stats,
+                              const RunTimings &timings) {
+  const auto &generation = stats.generation;
+  const auto prefill_ms =
+      std::max(0.0, generation.prefill_ms - generation.tokenize_ms -
+                        generation.context_ms);
+  const auto evaluated_tokens =
+      generation.prompt_tokens - generation.cached_tokens;
+
+  JsonWriter llama;
+  llama.add("prompt_eval_ms", generation.llama_prompt_eval_ms)
+      .add("prompt_eval_tokens",
+           static_cast<std::uint64_t>(generation.llama_prompt_eval_tokens))
+      .add("prompt_eval_tokens_per_s",
+           per_second(generation.llama_prompt_eval_tokens,
+                      generation.llama_prompt_eval_ms))
+      .add("eval_ms", generation.llama_eval_ms)
+      .add("eval_tokens",
+           static_cast<std::uint64_t>(generation.llama_eval_tokens))
+      .add("eval_tokens_per_s", per_second(generation.llama_eval_tokens,
+                                           generation.llama_eval_ms));
+
+  const auto &startup_timings = timings.startup;
+  JsonWriter startup;
+  startup.add("backend_ms", startup_timings.backend_ms)
+      .add("model_load_ms", timings.model_load_ms)
+      .add("prefetch_submit_ms", startup_timings.prefetch_submit_ms)
+      .add("prefetched_bytes",
+           static_cast<std::uint64_t>(startup_timings.prefetched_bytes))
+      .add("warmup_ms", startup_timings.warmup_ms)
+      .add("startup_ms", startup_timings.backend_ms + timings.model_load_ms +
+                             startup_timings.warmup_ms);
+
+  JsonWriter record;
+  record.add("model_load_ms", timings.model_load_ms)
+      .add("tokenize_ms", generation.tokenize_ms)
+      .add("context_ms", generation.context_ms)
+      .add("prefill_ms", prefill_ms)
+      .add("decode_ms", generation.decode_ms)
+      .add("output_ms", generation.output_ms)
+      .add("total_ms", timings.total_ms)
+      .add("piece_table_ms", timings.piece_table_ms)
+      .add("piece_table_bytes",
+           static_cast<std::uint64_t>(timings.piece_table_bytes))
+      .add("input_bytes", static_cast<std::uint64_t>(stats.document_bytes))
+      .add("document_tokens", static_cast<std::uint64_t>(stats.document_tokens))
+      .add("chunks", static_cast<std::uint64_t>(stats.number_of_chunks))
+      .add("dropped_bytes", static_cast<std::uint64_t>(stats.dropped_bytes))
+      .add("dropped_tokens", static_cast<std::uint64_t>(stats.dropped_tokens))
+      .add("dropped_ratio",
+           ratio(stats.dropped_tokens, stats.document_tokens))
+      .add("collapsed_lines",
+           static_cast<std::uint64_t>(stats.collapsed_lines))
+      .add("prompt_tokens",
+           static_cast<std::uint64_t>(generation.prompt_tokens))
+      .add("cached_tokens",
+           static_cast<std::uint64_t>(generation.cached_tokens))
+      .add("generated_tokens",
+           static_cast<std::uint64_t>(generation.generated_tokens))
+      .add("prefill_tokens_per_s", per_second(evaluated_tokens, prefill_ms))
+      .add("decode_tokens_per_s",
+           per_second(generation.generated_tokens, generation.decode_ms))
+      .add("time_to_first_token_ms", generation.time_to_first_token_ms)
+      .add("target_decodes",
+           static_cast<std::uint64_t>(generation.target_decodes))
+      .add("draft_tokens", static_cast<std::uint64_t>(generation.draft_tokens))
+      .add("accepted_draft_tokens",
+           static_cast<std::uint64_t>(generation.accepted_draft_tokens))
+      .add("draft_acceptance_rate",
+           ratio(generation.accepted_draft_tokens, generation.draft_tokens))
+      .add("tokens_per_target_decode",
+           ratio(generation.generated_tokens, generation.target_decodes))
+      .add("context_size", static_cast<std::uint64_t>(generation.context_size))
+      .add("kv_bytes", static_cast<std::uint64_t>(generation.kv_bytes))
+      .add_raw("startup", startup.str())
+      .add_raw("llama", llama.str());
+
+  return record.str();
+}
+
+std::string make_memory_record(const MemoryEstimate &estimate,
+                               const ContextSettings &settings,
+                               const SummaryStats &stats) {
+  const auto flash_attention =
+      settings.flash_attention == LLAMA_FLASH_ATTN_TYPE_ENABLED    ? "on"
+      : settings.flash_attention == LLAMA_FLASH_ATTN_TYPE_DISABLED ? "off"
+                                                                   : "auto";
+
+  JsonWriter record;
+  record.add("input_bytes", static_cast<std::uint64_t>(stats.document_bytes))
+      .add("document_tokens", static_cast<std::uint64_t>(stats.document_tokens))
+      .add("dropped_tokens", static_cast<std::uint64_t>(stats.dropped_tokens))
+      .add("context_size", static_cast<std::uint64_t>(estimate.context_size))
+      .add("contexts", static_cast<std::uint64_t>(estimate.number_of_contexts))
+      .add("cache_type_k", ggml_type_name(settings.type_k))
+      .add("cache_type_v", ggml_type_name(settings.type_v))
+      .add("flash_attention", flash_attention)
+      .add("kv_bytes", static_cast<std::uint64_t>(estimate.kv_bytes))
+      .add("compute_bytes", static_cast<std::uint64_t>(estimate.compute_bytes))
+      .add("weights_bytes", static_cast<std::uint64_t>(estimate.weights_bytes))
+      .add("total_bytes",
+           static_cast<std::uint64_t>(estimate.kv_bytes +
+                                      estimate.compute_bytes +
+                                      estimate.weights_bytes));
+
+  return record.str();
+}
+} // namespace model_wrapper
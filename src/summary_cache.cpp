@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: summary_cache.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "summary_cache.h"
+#include "hash.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace model_wrapper {
+
+SummaryCache::SummaryCache(std::filesystem::path directory,
+                           const std::uintmax_t max_bytes,
+                           const std::string_view configuration)
+    : m_directory(std::move(directory)), m_max_bytes(max_bytes),
+      m_configuration_hash(hash_bytes(configuration)) {
+  std::filesystem::create_directories(m_directory);
+}
+
+std::string SummaryCache::make_key(const std::string_view document) const {
+  // Two differently seeded hashes make collisions between documents
+  // practically impossible
+  return to_hex(hash_bytes(document, m_configuration_hash)) +
+         to_hex(hash_bytes(document, ~m_configuration_hash));
+}
+
+std::optional<std::string>
+SummaryCache::lookup(const std::string &key) const {
+  const auto entry_path = m_directory / (key + std::string{ENTRY_EXTENSION});
+  std::ifstream entry{entry_path, std::ios::binary};
+  if (!entry) {
+    return std::nullopt;
+  }
+
+  // The entry starts with its key, anything else is not a valid entry
+  std::string stored_key;
+  if (!std::getline(entry, stored_key) || stored_key != key) {
+    return std::nullopt;
+  }
+  std::string summary{std::istreambuf_iterator<char>(entry),
+                      std::istreambuf_iterator<char>()};
+
+  // Mark the entry as recently used, it may be evicted meanwhile
+  std::error_code error;
+  std::filesystem::last_write_time(
+      entry_path, std::filesystem::file_time_type::clock::now(), error);
+
+  return summary;
+}
+
+void SummaryCache::store(const std::string &key,
+                         std::string_view summary) const {
+  while (!summary.empty() && summary.back() == '\n') {
+    summary.remove_suffix(1U);
+  }
+
+  const auto entry_path = m_directory / (key + std::string{ENTRY_EXTENSION});
+  auto temporary_path = entry_path;
+  temporary_path += ".tmp" + std::to_string(getpid());
+
+  std::error_code error;
+  {
+    std::ofstream entry{temporary_path, std::ios::binary | std::ios::trunc};
+    entry << key << '\n' << summary << '\n';
+    if (!entry.flush()) {
+      std::filesystem::remove(temporary_path, error);
+      return;
+    }
+  }
+
+  std::filesystem::rename(temporary_path, entry_path, error);
+  if (error) {
+    std::filesystem::remove(temporary_path, error);
+    return;
+  }
+
+  evict();
+}
+
+void SummaryCache::evict() const {
+  struct Entry {
+    std::filesystem::path path;
+    std::filesystem::file_time_type last_used;
+    std::uintmax_t size;
+  };
+
+  std::error_code error;
+  std::vector<Entry> entries;
+  std::uintmax_t total_bytes{0U};
+  for (const auto &file :
+       std::filesystem::directory_iterator{m_directory, error}) {
+    if (file.path().extension() != ENTRY_EXTENSION) {
+      continue;
+    }
+    // Other processes may remove entries while they are listed
+    const auto size = file.file_size(error);
+    const auto last_used = file.last_write_time(error);
+    if (!error) {
+      entries.push_back({file.path(), last_used, size});
+      total_bytes += size;
+    }
+  }
+
+  if (total_bytes <= m_max_bytes) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const auto &lhs, const auto &rhs) {
+              return lhs.last_used < rhs.last_used;
+            });
+  for (const auto &entry : entries) {
+    if (total_bytes <= m_max_bytes) {
+      break;
+    }
+    std::filesystem::remove(entry.path, error);
+    total_bytes -= entry.size;
+  }
+}
+} // namespace model_wrapper
@@ -0,0 +1,289 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: summary_server.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "summary_server.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <semaphore>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace model_wrapper {
+
+namespace {
+constexpr char FRAME_TEXT{'T'};
+constexpr char FRAME_DONE{'D'};
+constexpr char FRAME_ERROR{'E'};
+
+/**
+ * \brief Closes the file descriptor when it goes out of scope
+ */
+struct SocketGuard {
+  int fd;
+
+  explicit SocketGuard(const int socket_fd) : fd(socket_fd) {}
+  ~SocketGuard() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  SocketGuard(const SocketGuard &) = delete;
+  SocketGuard &operator=(const SocketGuard &) = delete;
+};
+
+void write_all(const int fd, const char *data, std::size_t size) {
+  while (size > 0U) {
+    // MSG_NOSIGNAL: a client that went away must not kill the server
+    const auto written = send(fd, data, size, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      throw std::runtime_error{std::string{"Socket write failed: "} +
+                               std::strerror(errno)};
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+bool read_all(const int fd, char *data, std::size_t size) {
+  while (size > 0U) {
+    const auto number_of_read = recv(fd, data, size, 0);
+    if (number_of_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (number_of_read <= 0) {
+      return false;
+    }
+    data += number_of_read;
+    size -= number_of_read;
+  }
+  return true;
+}
+
+template <typename T> void encode(T value, char *data) {
+  for (int i = sizeof(T) - 1; i >= 0; --i) {
+    data[i] = static_cast<char>(value & 0xFFU);
+    value >>= 8U;
+  }
+}
+
+template <typename T> T decode(const char *data) {
+  T value{0U};
+  for (std::size_t i = 0U; i < sizeof(T); ++i) {
+    value = (value << 8U) | static_cast<unsigned char>(data[i]);
+  }
+  return value;
+}
+
+void write_frame(const int fd, const char type,
+                 const std::string_view payload) {
+  std::array<char, 5> header{type};
+  encode(static_cast<std::uint32_t>(payload.size()), header.data() + 1);
+  write_all(fd, header.data(), header.size());
+  write_all(fd, payload.data(), payload.size());
+}
+
+/**
+ * \brief Stream buffer that sends its content as text frames on flush
+ */
+class FrameStreamBuf : public std::streambuf {
+private:
+  const int m_fd;
+  std::array<char, 4096> m_buffer{};
+
+protected:
+  int_type overflow(const int_type character) override {
+    if (sync() != 0) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(character, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(character);
+      pbump(1);
+    }
+    return traits_type::not_eof(character);
+  }
+
+  int sync() override {
+    if (pptr() == pbase()) {
+      return 0;
+    }
+    const std::size_t size = pptr() - pbase();
+    write_frame(m_fd, FRAME_TEXT, {pbase(), size});
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    return 0;
+  }
+
+public:
+  explicit FrameStreamBuf(const int fd) : m_fd(fd) {
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  }
+};
+
+sockaddr_un make_address(const std::string &socket_path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error{"Socket path is too long: " + socket_path};
+  }
+  std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1U);
+  return address;
+}
+} // namespace
+
+SummaryServer::SummaryServer(ChunkedSummarizer &summarizer,
+                             std::string socket_path,
+                             const std::size_t max_clients)
+    : m_summarizer(summarizer), m_socket_path(std::move(socket_path)),
+      m_max_clients(std::max<std::size_t>(1U, max_clients)) {}
+
+void SummaryServer::serve_client(const int client_fd) {
+  const SocketGuard client{client_fd};
+
+  try {
+    std::array<char, sizeof(std::uint64_t)> header{};
+    if (!read_all(client.fd, header.data(), header.size())) {
+      return;
+    }
+
+    const auto document_size = decode<std::uint64_t>(header.data());
+    if (document_size > MAX_DOCUMENT_SIZE) {
+      write_frame(client.fd, FRAME_ERROR, "Document is too large!");
+      return;
+    }
+
+    std::string document(document_size, '\0');
+    if (!read_all(client.fd, document.data(), document.size())) {
+      return;
+    }
+
+    if (document.empty()) {
+      write_frame(client.fd, FRAME_TEXT, "Nothing to summarize!\n");
+      write_frame(client.fd, FRAME_DONE, {});
+      return;
+    }
+
+    FrameStreamBuf frame_buffer{client.fd};
+    std::ostream out{&frame_buffer};
+    try {
+      m_summarizer.summarize(document, out);
+      out.flush();
+      write_frame(client.fd, FRAME_DONE, {});
+    } catch (const std::exception &e) {
+      out.flush();
+      write_frame(client.fd, FRAME_ERROR, e.what());
+    }
+  } catch (const std::exception &e) {
+    // The client went away, nothing left to report to
+    std::cerr << "Client failed: " << e.what() << std::endl;
+  }
+}
+
+void SummaryServer::run() {
+  const auto address = make_address(m_socket_path);
+
+  // Replace the socket of a previous server, but never a regular file
+  struct stat status {};
+  if (lstat(m_socket_path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+    unlink(m_socket_path.c_str());
+  }
+
+  const SocketGuard server{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+  if (server.fd < 0 ||
+      bind(server.fd, reinterpret_cast<const sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(server.fd, SOMAXCONN) != 0) {
+    throw std::runtime_error{"Cannot listen on " + m_socket_path + ": " +
+                             std::strerror(errno)};
+  }
+
+  std::cerr << "Listening on " << m_socket_path << std::endl;
+
+  std::counting_semaphore<> client_slots(m_max_clients);
+  while (true) {
+    client_slots.acquire();
+
+    const int client_fd = accept4(server.fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client_fd < 0) {
+      client_slots.release();
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      throw std::runtime_error{std::string{"Cannot accept client: "} +
+                               std::strerror(errno)};
+    }
+
+    std::thread{[this, client_fd, &client_slots]() {
+      serve_client(client_fd);
+      client_slots.release();
+    }}.detach();
+  }
+}
+
+SummaryClient::SummaryClient(std::string socket_path)
+    : m_socket_path(std::move(socket_path)) {}
+
+void SummaryClient::summarize(std::istream &in, std::ostream &out) const {
+  const auto address = make_address(m_socket_path);
+
+  const SocketGuard connection{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+  if (connection.fd < 0 ||
+      connect(connection.fd, reinterpret_cast<const sockaddr *>(&address),
+              sizeof(address)) != 0) {
+    throw std::runtime_error{"Cannot connect to " + m_socket_path + ": " +
+                             std::strerror(errno)};
+  }
+
+  const std::string document{std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>()};
+  std::array<char, sizeof(std::uint64_t)> header{};
+  encode(static_cast<std::uint64_t>(document.size()), header.data());
+  write_all(connection.fd, header.data(), header.size());
+  write_all(connection.fd, document.data(), document.size());
+
+  std::string payload;
+  while (true) {
+    std::array<char, 5> frame_header{};
+    if (!read_all(connection.fd, frame_header.data(), frame_header.size())) {
+      throw std::runtime_error{"Server closed the connection!"};
+    }
+
+    payload.resize(decode<std::uint32_t>(frame_header.data() + 1));
+    if (!read_all(connection.fd, payload.data(), payload.size())) {
+      throw std::runtime_error{"Server closed the connection!"};
+    }
+
+    switch (frame_header[0]) {
+    case FRAME_TEXT:
+      out << payload;
+      out.flush();
+      break;
+    case FRAME_DONE:
+      return;
+    case FRAME_ERROR:
+      throw std::runtime_error{payload};
+    default:
+      throw std::runtime_error{"Unexpected frame from server!"};
+    }
+  }
+}
+} // namespace model_wrapper
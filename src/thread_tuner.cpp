@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: thread_tuner.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "thread_tuner.h"
+#include "cache_directory.h"
+#include "cpu_placement.h"
+#include "hash.h"
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+namespace model_wrapper {
+
+namespace {
+std::string get_host_name() {
+  char host_name[256]{};
+  if (gethostname(host_name, sizeof(host_name) - 1U) != 0) {
+    return "unknown";
+  }
+  return host_name;
+}
+
+/**
+ * \brief Build a prompt of the given number of tokens from repeated text
+ */
+std::vector<llama_token> make_prompt(const Model &model,
+                                     const std::size_t number_of_tokens) {
+  const auto sentence = model.tokenize_text(
+      "The worker threads read the shared buffer and flush it to disk. ");
+  if (sentence.empty()) {
+    throw std::runtime_error{"Cannot tune threads: Failed to tokenize!"};
+  }
+
+  std::vector<llama_token> prompt;
+  prompt.reserve(number_of_tokens);
+  while (prompt.size() < number_of_tokens) {
+    prompt.push_back(sentence[prompt.size() % sentence.size()]);
+  }
+  return prompt;
+}
+} // namespace
+
+ThreadTuner::ThreadTuner(std::filesystem::path cache_path,
+                         const std::string &model_path)
+    : m_cache_path(std::move(cache_path)),
+      m_key(to_hex(fingerprint_file(model_path)) + "-" +
+            to_hex(hash_bytes(get_host_name() + "/" +
+                              std::to_string(get_available_cpus())))) {}
+
+std::filesystem::path ThreadTuner::get_default_cache_path() {
+  return get_default_cache_directory() / "threads.conf";
+}
+
+std::vector<std::uint32_t>
+ThreadTuner::get_candidates(const std::size_t number_of_cpus) {
+  std::vector<std::uint32_t> candidates;
+  for (std::size_t count = 1U; count < number_of_cpus; count *= 2U) {
+    candidates.push_back(static_cast<std::uint32_t>(count));
+  }
+  candidates.push_back(static_cast<std::uint32_t>(number_of_cpus));
+  return candidates;
+}
+
+std::optional<ThreadConfig> ThreadTuner::load() const {
+  std::ifstream file{m_cache_path};
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields{line};
+    std::string key;
+    ThreadConfig config{};
+    if (fields >> key >> config.n_threads >> config.n_threads_batch &&
+        key == m_key && config.n_threads > 0U &&
+        config.n_threads_batch > 0U) {
+      return config;
+    }
+  }
+  return std::nullopt;
+}
+
+ThreadConfig ThreadTuner::tune(Model &model, std::ostream &log) const {
+  const auto prompt = make_prompt(model, PROMPT_TOKENS);
+  const auto candidates = get_candidates(get_available_cpus());
+
+  // The first run pays for allocating the context and warming the caches
+  model.measure_threads(prompt, DECODED_TOKENS, candidates.back());
+
+  ThreadConfig best{};
+  auto best_prefill_ms = std::numeric_limits<double>::max();
+  auto best_decode_ms = std::numeric_limits<double>::max();
+  for (const auto threads : candidates) {
+    const auto timings = model.measure_threads(prompt, DECODED_TOKENS, threads);
+    log << "threads " << threads << ": prefill "
+        << PROMPT_TOKENS * 1000.0 / timings.prefill_ms << " tokens/s, decode "
+        << DECODED_TOKENS * 1000.0 / timings.decode_ms << " tokens/s"
+        << std::endl;
+
+    if (timings.prefill_ms < best_prefill_ms) {
+      best_prefill_ms = timings.prefill_ms;
+      best.n_threads_batch = threads;
+    }
+    if (timings.decode_ms < best_decode_ms) {
+      best_decode_ms = timings.decode_ms;
+      best.n_threads = threads;
+    }
+  }
+
+  store(best);
+  return best;
+}
+
+void ThreadTuner::store(const ThreadConfig &config) const {
+  std::error_code error;
+  std::filesystem::create_directories(m_cache_path.parent_path(), error);
+
+  // Keep the entries of other models and hosts
+  std::ostringstream content;
+  {
+    std::ifstream file{m_cache_path};
+    std::string line;
+    while (std::getline(file, line)) {
+      if (!line.empty() && line.compare(0U, m_key.size(), m_key) != 0) {
+        content << line << '\n';
+      }
+    }
+  }
+  content << m_key << ' ' << config.n_threads << ' ' << config.n_threads_batch
+          << '\n';
+
+  auto temporary_path = m_cache_path;
+  temporary_path += ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream file{temporary_path, std::ios::trunc};
+    file << content.str();
+    if (!file.flush()) {
+      std::filesystem::remove(temporary_path, error);
+      throw std::runtime_error{"Cannot write thread config: " +
+                               m_cache_path.string()};
+    }
+  }
+
+  std::filesystem::rename(temporary_path, m_cache_path, error);
+  if (error) {
+    std::filesystem::remove(temporary_path, error);
+    throw std::runtime_error{"Cannot write thread config: " +
+                             m_cache_path.string()};
+  }
+}
+} // namespace model_wrapper
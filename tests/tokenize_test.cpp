@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// File: tokenize_test.cpp
+//
+// License: MIT
+//
+// Copyright (C) 2025 Onur Ozuduru
+//
+// Follow Me!
+//   github: github.com/onurozuduru
+///////////////////////////////////////////////////////////////////////////////
+
+#include "model.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+/**
+ * \brief Size from which tokenize_text uses all cores, see model.cpp
+ */
+constexpr std::size_t PARALLEL_TOKENIZE_SIZE{4U * 1024U * 1024U};
+
+/**
+ * \brief Build a deterministic text of at least the given size
+ * \details Lines mix words, numbers, punctuation, indentation, blank lines
+ * and multibyte characters, so shard boundaries fall on every kind of line
+ * start.
+ */
+std::string make_text(const std::size_t size) {
+  constexpr const char *WORDS[] = {
+      "the",   "server", "accepts",  "connection", "request", "headers",
+      "cache", "entry",  "expires",  "worker",     "threads", "queued",
+      "jobs",  "buffer", "flushes",  "Größe",      "naïve",   "日本語",
+      "€",     "🙂",     "0x1f",     "42",         "3.14",    "--flag",
+      "(a)",   "[b]",    "{c}",      "\"quoted\"", "it's",    "e-mail"};
+  constexpr const char *LINE_STARTS[] = {"", "", "", "  ", "\t", "- ", "# ",
+                                         "\n", " ", "1. "};
+  constexpr std::size_t NUMBER_OF_WORDS = std::size(WORDS);
+  constexpr std::size_t NUMBER_OF_LINE_STARTS = std::size(LINE_STARTS);
+
+  std::string text;
+  text.reserve(size + 256U);
+  std::uint32_t state{12345U};
+  const auto next = [&state]() {
+    state = state * 1664525U + 1013904223U;
+    return state >> 8U;
+  };
+
+  while (text.size() < size) {
+    text.append(LINE_STARTS[next() % NUMBER_OF_LINE_STARTS]);
+    const auto number_of_words = 1U + next() % 16U;
+    for (std::size_t i = 0U; i < number_of_words; ++i) {
+      if (i > 0U) {
+        text.push_back(next() % 8U == 0U ? ',' : ' ');
+      }
+      text.append(WORDS[next() % NUMBER_OF_WORDS]);
+    }
+    text.append(next() % 4U == 0U ? ".\r\n" : ".\n");
+  }
+  return text;
+}
+
+/**
+ * \brief Compare parallel with serial tokenization of a text
+ * \return true if the tokens are the same
+ */
+bool check(const model_wrapper::Model &model, const std::string &name,
+           const std::string &text, const std::size_t number_of_threads) {
+  const auto serial_tokens = model.tokenize_text(text, 1U);
+  const auto parallel_tokens =
+      number_of_threads > 0U ? model.tokenize_text(text, number_of_threads)
+                             : model.tokenize_text(text);
+
+  if (serial_tokens == parallel_tokens) {
+    std::cout << "PASS " << name << ": " << text.size() << " bytes, "
+              << serial_tokens.size() << " tokens" << std::endl;
+    return true;
+  }
+
+  const auto mismatch =
+      std::mismatch(serial_tokens.begin(), serial_tokens.end(),
+                    parallel_tokens.begin(), parallel_tokens.end());
+  std::cout << "FAIL " << name << ": " << serial_tokens.size()
+            << " serial and " << parallel_tokens.size()
+            << " parallel tokens, first difference at token "
+            << (mismatch.first - serial_tokens.begin()) << std::endl;
+  return false;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <model or vocabulary file>"
+              << std::endl;
+    return 2;
+  }
+
+  try {
+    model_wrapper::LoadSettings load_settings{};
+    load_settings.is_vocab_only = true;
+    const model_wrapper::Model model{argv[1], 0.5f, 0, 1U, load_settings};
+
+    const auto large_text = make_text(2U * PARALLEL_TOKENIZE_SIZE + 12345U);
+    auto single_line = make_text(PARALLEL_TOKENIZE_SIZE + 1U);
+    std::replace(single_line.begin(), single_line.end(), '\n', ' ');
+
+    bool is_passed{true};
+    // Below the threshold tokenize_text stays serial, threads are forced
+    is_passed &= check(model, "small", make_text(4096U), 8U);
+    is_passed &= check(model, "below-threshold",
+                       make_text(PARALLEL_TOKENIZE_SIZE - 4096U), 8U);
+    // Across the threshold tokenize_text picks the threads itself
+    is_passed &= check(model, "above-threshold",
+                       make_text(PARALLEL_TOKENIZE_SIZE + 1U), 0U);
+    is_passed &= check(model, "large", large_text, 0U);
+    is_passed &= check(model, "large-3-threads", large_text, 3U);
+    // No line start to split at
+    is_passed &= check(model, "single-line", single_line, 0U);
+
+    return is_passed ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cerr << "Failed: " << e.what() << std::endl;
+    return 1;
+  }
+}